@@ -1,254 +1,444 @@
-#include <map>
-#include <stack>
+#include <unordered_map>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <iostream>
-#include <sstream>
+#include <charconv>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
-struct Node
+//// Input and output. /////////////////////////////////////////////////////////
+// Standard input is mapped when it is a regular file and read whole
+// otherwise. Names are views into it, so it stays until the program ends.
+class Input
 {
-    Node(const string&, size_t);
-    ~Node();
+public:
+    Input() : mapped(0), mappedSize(0), pos(0), end(0) {}
+    ~Input()
+    {
+        if (mapped)
+            munmap(mapped, mappedSize);
+    }
 
-    Node* addChild(Node*);
-    Node* addChild(const string&, size_t);
-    Node* pythonNext();
-    static Node* findNext();
+    // False if standard input cannot be read.
+    bool open()
+    {
+        struct stat status;
+        off_t offset = lseek(0, 0, SEEK_CUR);
+        if (fstat(0, &status) == 0 && S_ISREG(status.st_mode) &&
+            offset >= 0 && status.st_size > offset)
+        {
+            mappedSize = size_t(status.st_size);
+            mapped = mmap(0, mappedSize, PROT_READ, MAP_PRIVATE, 0, 0);
+            if (mapped != MAP_FAILED)
+            {
+                madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+                pos = static_cast<const char*>(mapped) + offset;
+                end = static_cast<const char*>(mapped) + mappedSize;
+                return true;
+            }
+            mapped = 0;
+        }
 
-    Node* parent;
-    Node* lChild;
-    Node* rChild;
-    Node* lSibling;
-    Node* rSibling;
+        char chunk[1 << 16];
+        ssize_t got;
+        while ((got = read(0, chunk, sizeof(chunk))) != 0)
+        {
+            if (got < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            buffer.append(chunk, size_t(got));
+        }
+        pos = buffer.data();
+        end = pos + buffer.size();
+        return true;
+    }
 
-    size_t id;
-    string name;
-    size_t depth;
-    size_t amountOfChildren;
+    // All of the input, for addressing names by offset.
+    string_view all() const
+    {
+        if (mapped)
+            return string_view(static_cast<const char*>(mapped), mappedSize);
+        return buffer;
+    }
 
-    // Static
-    static void deleteTree();
+    // The next run of characters up to white space.
+    string_view token()
+    {
+        while (pos < end && isSpace(*pos))
+            pos++;
+        const char* begin = pos;
+        while (pos < end && !isSpace(*pos))
+            pos++;
+        return string_view(begin, size_t(pos - begin));
+    }
 
-    static map<size_t, Node*> nodesById;
-};
+    template <class T>
+    T number()
+    {
+        return parse<T>(token());
+    }
 
-map<size_t, Node*> Node::nodesById;
+    // The rest of the current line, without the '\n'.
+    string_view line()
+    {
+        const char* begin = pos;
+        while (pos < end && *pos != '\n')
+            pos++;
+        string_view s(begin, size_t(pos - begin));
+        if (pos < end)
+            pos++;
+        return s;
+    }
 
-Node::Node(const string& name, size_t id) : parent(0), lChild(0), rChild(0),
-                                            lSibling(0), rSibling(0), id(id),
-                                            name(name), depth(0),
-                                            amountOfChildren(0)
-{
-    nodesById[id] = this;
-}
+    template <class T>
+    static T parse(string_view s)
+    {
+        T value = 0;
+        from_chars(s.data(), s.data() + s.size(), value);
+        return value;
+    }
+
+private:
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+    }
 
-Node::~Node()
+    void* mapped;
+    size_t mappedSize;
+    string buffer;
+    const char* pos;
+    const char* end;
+
+    Input(const Input&);
+    Input& operator=(const Input&);
+};
+
+// Collects output and writes it to standard output a buffer at a time.
+class Output
 {
-    if (lChild)
+public:
+    Output() : used(0) {}
+    ~Output() { flush(); }
+
+    void put(char c)
+    {
+        if (used == sizeof(buffer))
+            flush();
+        buffer[used++] = c;
+    }
+
+    void put(string_view s)
     {
-        while (lChild)
+        if (s.size() > sizeof(buffer) - used)
         {
-            Node* sibling = lChild->rSibling;
-            delete lChild;
-            lChild = sibling;
+            flush();
+            if (s.size() > sizeof(buffer))
+            {
+                writeAll(s.data(), s.size());
+                return;
+            }
         }
+        s.copy(buffer + used, s.size());
+        used += s.size();
     }
-}
-
-void Node::deleteTree()
-{
-    if (nodesById.size() > 0)
-        delete nodesById[0];
-}
 
-Node* Node::addChild(const string& name, size_t id)
-{
-    Node* child = new Node(name, id);
+    template <class T>
+    void putNumber(T value)
+    {
+        if (sizeof(buffer) - used < 24)
+            flush();
+        used = size_t(to_chars(buffer + used, buffer + sizeof(buffer),
+                               value).ptr - buffer);
+    }
 
-    child->parent = this;
-    child->depth = depth + 1;
+    void flush()
+    {
+        writeAll(buffer, used);
+        used = 0;
+    }
 
-    if (lChild)
+private:
+    static void writeAll(const char* data, size_t size)
     {
-        child->rSibling = lChild;
-        lChild->lSibling = child;
+        while (size > 0)
+        {
+            ssize_t written = write(1, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            data += written;
+            size -= size_t(written);
+        }
     }
-    else
-        rChild = child;
 
-    lChild = child;
+    char buffer[1 << 20];
+    size_t used;
+};
 
-    amountOfChildren++;
+Input in;
+Output out;
 
-    return child;
+// Reports malformed input and ends the program.
+[[noreturn]] void fail(string_view message)
+{
+    out.flush();
+    string line(message);
+    line += '\n';
+    ssize_t written = write(2, line.data(), line.size());
+    (void)written;
+    exit(1);
 }
+//// End of input and output. //////////////////////////////////////////////////
+
+
+// The tree as arrays indexed by id. Names are offsets into the input, so
+// nodes are not allocated one by one, and a pass over the ids reads each
+// array in order.
+typedef uint32_t NodeId;
+const NodeId NONE = UINT32_MAX;
+const NodeId ROOT = 0;
 
-Node* Node::addChild(Node* child)
+// An id of the input. Ids index the tree's arrays and NONE is reserved,
+// so anything that is not a number below NONE is an error.
+NodeId parseId(string_view s)
 {
-    child->parent = this;
-    child->depth = depth + 1;
+    uint64_t id = 0;
+    from_chars_result r = from_chars(s.data(), s.data() + s.size(), id);
+    if (s.empty() || r.ec != errc() || r.ptr != s.data() + s.size() ||
+        id >= NONE)
+        fail("Invalid node id '" + string(s) + "': ids must be numbers below "
+             + to_string(NONE) + ".");
+    return NodeId(id);
+}
 
-    if (lChild)
-    {
-        child->rSibling = lChild;
-        lChild->lSibling = child;
-    }
-    else
-        rChild = child;
+struct Tree
+{
+    Tree() : size(0) {}
 
-    lChild = child;
+    NodeId addNode(string_view, NodeId);
+    void addChild(NodeId, NodeId);
+    bool contains(NodeId id) const;
+    string_view name(NodeId id) const;
 
-    amountOfChildren++;
+    // Calls visit with every node in preorder and its depth.
+    template <class Visit>
+    void preorder(Visit visit) const;
 
-    return child;
-}
+    vector<NodeId> parent;
+    vector<NodeId> firstChild;  // Children are in the order they were added.
+    vector<NodeId> lastChild;
+    vector<NodeId> nextSibling;
+    vector<NodeId> amountOfChildren;
 
-Node* Node::pythonNext()
-{
-    if (rChild)
-        return rChild;
+    vector<size_t> nameBegin;   // string_view::npos for ids not in the tree.
+    vector<NodeId> nameLength;
+    string_view names;          // The input the names point into.
 
-    if (lSibling)
-        return lSibling;
+    size_t size;
+};
 
-    Node* tempParent = parent;
-    Node* sibling = tempParent->lSibling;
-    while (!sibling && tempParent->parent)
+Tree tree;
+
+NodeId Tree::addNode(string_view name, NodeId id)
+{
+    if (id >= parent.size())
     {
-        tempParent = tempParent->parent;
-        sibling = tempParent->lSibling;
+        // The arrays reach up to the largest id, however sparse the ids.
+        size_t n = min(max(size_t(id) + 1, 2 * parent.size()), size_t(NONE));
+        try
+        {
+            parent.resize(n, NONE);
+            firstChild.resize(n, NONE);
+            lastChild.resize(n, NONE);
+            nextSibling.resize(n, NONE);
+            amountOfChildren.resize(n, 0);
+            nameBegin.resize(n, string_view::npos);
+            nameLength.resize(n, 0);
+        }
+        catch (const bad_alloc&)
+        {
+            fail("Node id " + to_string(id) + " is too large to index.");
+        }
     }
+    if (nameBegin[id] == string_view::npos)
+        size++;
+    nameBegin[id] = size_t(name.data() - names.data());
+    nameLength[id] = NodeId(name.size());
+    return id;
+}
 
-    return sibling;
+void Tree::addChild(NodeId node, NodeId child)
+{
+    if (!contains(node) || !contains(child))
+        fail("Node " + to_string(contains(node) ? child : node)
+             + " is linked but never named.");
+    parent[child] = node;
+    if (lastChild[node] == NONE)
+        firstChild[node] = child;
+    else
+        nextSibling[lastChild[node]] = child;
+    lastChild[node] = child;
+    amountOfChildren[node]++;
 }
 
-Node* Node::findNext()
+bool Tree::contains(NodeId id) const
 {
-    static map<size_t, Node*>::iterator it = nodesById.begin();
+    return id < nameBegin.size() && nameBegin[id] != string_view::npos;
+}
 
-    if (++it != nodesById.end())
-        return it->second;
-    else
-        return 0;
+string_view Tree::name(NodeId id) const
+{
+    return names.substr(nameBegin[id], nameLength[id]);
+}
+
+template <class Visit>
+void Tree::preorder(Visit visit) const
+{
+    NodeId node = ROOT;
+    size_t depth = 0;
+    while (node != NONE)
+    {
+        visit(node, depth);
+        if (firstChild[node] != NONE)
+        {
+            node = firstChild[node];
+            depth++;
+            continue;
+        }
+        while (node != NONE && nextSibling[node] == NONE)
+        {
+            node = parent[node];
+            depth--;
+        }
+        if (node != NONE)
+            node = nextSibling[node];
+    }
 }
-//// End of Node structure definition. /////////////////////////////////////////
+//// End of Tree structure definition. /////////////////////////////////////////
 
 
 //// Functions for constructing tree. //////////////////////////////////////////
 void buildFindTree()
 {
-    size_t n;
-    cin >> n;
+    size_t n = in.number<size_t>();
 
-    size_t id;
-    string path;
-    map<string, Node*> nodeMap;
+    // Node for every full path read so far. Keys point into the input.
+    unordered_map<string_view, NodeId> nodeMap;
+    nodeMap.reserve(n);
     for (size_t i = 0; i < n; i++)
     {
-        cin >> path >> id;
+        string_view path = in.token();
+        NodeId id = parseId(in.token());
 
         size_t rightMostSlash = path.rfind('/');
-        size_t leftSlash = path.rfind('/', rightMostSlash - 1);
 
-        if (rightMostSlash == string::npos)
+        if (rightMostSlash == string_view::npos)
         {
-            Node* root = new Node(path, id);
-            nodeMap[path] = root;
+            nodeMap[path] = tree.addNode(path, id);
         }
         else
         {
-            Node* parent;
-            if (leftSlash == string::npos)
-                parent = nodeMap[path.substr(0, rightMostSlash)];
-            else
-                parent = nodeMap[path.substr(leftSlash + 1,
-                                             rightMostSlash - leftSlash - 1)];
-
-            string childName = path.substr(rightMostSlash + 1);
-            Node* child = parent->addChild(childName, id);
-            nodeMap[childName] = child;
+            NodeId child = tree.addNode(path.substr(rightMostSlash + 1), id);
+            string_view parentPath = path.substr(0, rightMostSlash);
+            auto parent = nodeMap.find(parentPath);
+            if (parent == nodeMap.end())
+                fail("Parent path '" + string(parentPath) + "' of '"
+                     + string(path) + "' is not listed before it.");
+            tree.addChild(parent->second, child);
+            nodeMap[path] = child;
         }
     }
 }
 
 void buildPythonTree()
 {
-    size_t n;
-    cin >> n;
-    cin.ignore();       // Discard '\n'.
+    size_t n = in.number<size_t>();
+    in.line();          // Discard '\n'.
 
     // Depth of the previous node.
     size_t prevDepth = 0;
     // Last node at depth j. Used for finding parent.
-    vector<Node*> lastNode(n);
+    vector<NodeId> lastNode(n);
 
-    // Build tree and fill nodesById.
+    // Build tree.
     for (size_t i = 0; i < n; i++)
     {
-        string s;       // File|Folder name + id.
-        getline(cin, s);
+        string_view s = in.line();      // File|Folder name + id.
 
         size_t nameBegPos = s.find_first_not_of(' ');
         size_t nameEndPos = s.rfind(' ');
 
-        size_t id;
-        stringstream ss;
-        ss << s.substr(nameEndPos + 1);
-        ss >> id;
+        NodeId id = parseId(s.substr(nameEndPos + 1));
 
         if (id == 0) // Root
         {
-            Node* root = new Node(s.substr(0, s.size() - 2), id);
-            lastNode[0] = root;
+            lastNode[0] = tree.addNode(s.substr(0, s.size() - 2), id);
             prevDepth = 0;
         }
         else
         {
             size_t depth = nameBegPos / 4;
-            Node* child = 0;
-            Node* parent = 0;
+            NodeId parent;
 
             if (depth > prevDepth) // Parent is last node at prevDepth.
                 parent = lastNode[prevDepth];
             else // Last node at a lesser depth. depth <= prevDepth.
                 parent = lastNode[depth - 1];
 
-            child = parent->addChild(s.substr(nameBegPos,
-                                     nameEndPos - nameBegPos), id);
+            NodeId child = tree.addNode(s.substr(nameBegPos,
+                                        nameEndPos - nameBegPos), id);
+            tree.addChild(parent, child);
             prevDepth = depth;
             lastNode[depth] = child;
         }
     }
 }
 
-void buildAcm1Tree()
+// The "name id" lines that start every acm format.
+void buildAcmNodes()
 {
-    size_t n;
-    cin >> n;
+    size_t n = in.number<size_t>();
 
     for (size_t i = 0; i < n; i++)
     {
-        size_t id;
-        string name;
-        cin >> name >> id;
+        string_view name = in.token();
+        NodeId id = parseId(in.token());
 
-        // Store nodes in a static map. They do not form a tree now.
-        new Node(name, id);
+        // They do not form a tree now.
+        tree.addNode(name, id);
     }
+}
+
+void buildAcm1Tree()
+{
+    buildAcmNodes();
 
-    map<size_t, Node*>::iterator it;
-    for (it = Node::nodesById.begin(); it != Node::nodesById.end(); ++it)
+    for (NodeId node = 0; node < tree.nameBegin.size(); node++)
     {
-        size_t amountOfChildren;
-        cin >> amountOfChildren;
+        if (!tree.contains(node))
+            continue;
+
+        size_t amountOfChildren = in.number<size_t>();
 
         while (amountOfChildren)
         {
-            size_t id;
-            cin >> id;
-            it->second->addChild(Node::nodesById[id]);
+            tree.addChild(node, parseId(in.token()));
             amountOfChildren--;
         }
     }
@@ -256,82 +446,59 @@ void buildAcm1Tree()
 
 void buildAcm2Tree()
 {
-    size_t n;
-    cin >> n;
+    buildAcmNodes();
 
-    for (size_t i = 0; i < n; i++)
+    for (NodeId node = 0; node < tree.nameBegin.size(); node++)
     {
-        size_t id;
-        string name;
-        cin >> name >> id;
+        if (!tree.contains(node))
+            continue;
 
-        new Node(name, id);
-    }
-
-    map<size_t, Node*>::iterator it;
-    for (it = Node::nodesById.begin(); it != Node::nodesById.end(); ++it)
-    {
-        int parentID;
-        cin >> parentID;
+        string_view parentID = in.token();
 
-        if (parentID != -1)
-            Node::nodesById[parentID]->addChild(it->second);
+        if (parentID != "-1")
+            tree.addChild(parseId(parentID), node);
     }
 }
 
 void buildAcm3Tree()
 {
-    size_t n;
-    cin >> n;
+    buildAcmNodes();
 
-    for (size_t i = 0; i < n; i++)
+    for (size_t i = 0; i + 1 < tree.size; i++)
     {
-        size_t id;
-        string name;
-        cin >> name >> id;
+        NodeId parentID = parseId(in.token());
+        NodeId childID = parseId(in.token());
 
-        new Node(name, id);
-    }
-
-    for (size_t i = 0; i < n - 1; i++)
-    {
-        size_t parentID, childID;
-        cin >> parentID >> childID;
-
-        Node::nodesById[parentID]->addChild(Node::nodesById[childID]);
+        tree.addChild(parentID, childID);
     }
 }
 
 void buildXmlTree()
 {
-    cin.ignore(); // Get rid of '\n'.
+    in.line(); // Get rid of '\n'.
 
     size_t openDirTags = 0;
-    vector<Node*> lastDirNode;
+    vector<NodeId> lastDirNode;
     do
     {
-        string tag;
-        getline(cin, tag);
+        string_view tag = in.line();
 
         if (tag[2 * openDirTags + 1] == 'd') // Open <dir> tag.
         {
             size_t begNamePos = 2 * openDirTags + 11;
             size_t endNamePos = tag.find('\'', begNamePos);
 
-            string name = tag.substr(begNamePos, endNamePos - begNamePos);
+            string_view name = tag.substr(begNamePos, endNamePos - begNamePos);
 
             size_t idBegPos = endNamePos + 6;
             size_t idEndPos = tag.size() - 2;
 
-            size_t id;
-            stringstream ss;
-            ss << tag.substr(idBegPos, idEndPos - idBegPos);
-            ss >> id;
+            NodeId id = parseId(tag.substr(idBegPos, idEndPos - idBegPos));
 
-            Node* node = new Node(name, id); // Directory node.
+            NodeId node = tree.addNode(name, id); // Directory node.
 
             if (openDirTags > 0)
-                lastDirNode[openDirTags - 1]->addChild(node);
+                tree.addChild(lastDirNode[openDirTags - 1], node);
 
             if (lastDirNode.size() > openDirTags)
                 lastDirNode[openDirTags] = node;
@@ -345,19 +512,16 @@ void buildXmlTree()
             size_t begNamePos = 2 * openDirTags + 12;
             size_t endNamePos = tag.find('\'', begNamePos);
 
-            string name = tag.substr(begNamePos, endNamePos - begNamePos);
+            string_view name = tag.substr(begNamePos, endNamePos - begNamePos);
 
             size_t idBegPos = endNamePos + 6;
             size_t idEndPos = tag.size() - 3;
 
-            size_t id;
-            stringstream ss;
-            ss << tag.substr(idBegPos, idEndPos - idBegPos);
-            ss >> id;
+            NodeId id = parseId(tag.substr(idBegPos, idEndPos - idBegPos));
 
-            Node* node = new Node(name, id); // File node.
+            NodeId node = tree.addNode(name, id); // File node.
 
-            lastDirNode[openDirTags - 1]->addChild(node);
+            tree.addChild(lastDirNode[openDirTags - 1], node);
         }
         else                    // </dir> tag.
             openDirTags--;
@@ -369,148 +533,165 @@ void buildXmlTree()
 
 void outputFindTree()
 {
-    cout << Node::nodesById.size() << '\n';
+    out.putNumber(tree.size);
+    out.put('\n');
 
-    stack<string> names;
-    Node* node = Node::nodesById[0];
-    cout << node->name << ' ' << node->id << '\n';
-    while ((node = Node::findNext()))
+    // Path of the current node, and where the path at each depth ends.
+    string path;
+    vector<size_t> pathEnd;
+    tree.preorder([&path, &pathEnd](NodeId node, size_t depth)
     {
-        size_t id = node->id;
-        while (node)
-        {
-            names.push(node->name);
-            node = node->parent;
-        }
-        while (names.size() > 1)
+        if (depth > 0)
         {
-            cout << names.top() << '/';
-            names.pop();
+            path.resize(pathEnd[depth - 1]);
+            path += '/';
         }
-        cout << names.top() << ' ' << id << "\n";
-        names.pop();
-    }
+        else
+            path.clear();
+        path += tree.name(node);
+
+        if (pathEnd.size() > depth)
+            pathEnd[depth] = path.size();
+        else
+            pathEnd.push_back(path.size());
+
+        out.put(path);
+        out.put(' ');
+        out.putNumber(node);
+        out.put('\n');
+    });
 }
 
 void outputPythonTree()
 {
-    const string space = "    ";
-
-    cout << Node::nodesById.size() << "\n"
-         << Node::nodesById[0]->name << ' ' << 0 << "\n";
+    const string_view space = "    ";
 
-    Node* node = Node::nodesById[0]; // Root.
-    while ((node = node->pythonNext()))
+    out.putNumber(tree.size);
+    out.put('\n');
+    tree.preorder([&space](NodeId node, size_t depth)
     {
-        for (size_t i = 1; i <= node->depth; i++)
-            cout << space;
+        for (size_t i = 1; i <= depth; i++)
+            out.put(space);
+
+        out.put(tree.name(node));
+        out.put(' ');
+        out.putNumber(node);
+        out.put('\n');
+    });
+}
 
-        cout << node->name << ' ' << node->id << "\n";
-    }
+// The "name id" lines that start every acm format.
+void outputAcmNodes()
+{
+    out.putNumber(tree.size);
+    out.put('\n');
+
+    for (NodeId id = 0; id < tree.nameBegin.size(); id++)
+        if (tree.contains(id))
+        {
+            out.put(tree.name(id));
+            out.put(' ');
+            out.putNumber(id);
+            out.put('\n');
+        }
 }
 
 void outputAcm1Tree()
 {
-    cout << Node::nodesById.size() << '\n';
-
-    map<size_t, Node*>::iterator it;
-    for (it = Node::nodesById.begin(); it != Node::nodesById.end(); ++it)
-        cout << it->second->name << ' ' << it->first << '\n';
+    outputAcmNodes();
 
-    for (it = Node::nodesById.begin(); it != Node::nodesById.end(); ++it)
+    for (NodeId id = 0; id < tree.nameBegin.size(); id++)
     {
-        cout << it->second->amountOfChildren << ' ';
+        if (!tree.contains(id))
+            continue;
 
-        Node* child = it->second->rChild;
-        while (child)
+        out.putNumber(tree.amountOfChildren[id]);
+        out.put(' ');
+
+        for (NodeId child = tree.firstChild[id]; child != NONE;
+             child = tree.nextSibling[child])
         {
-            cout << child->id << ' ';
-            child = child->lSibling;
+            out.putNumber(child);
+            out.put(' ');
         }
-        cout << '\n';
+        out.put('\n');
     }
 }
 
 void outputAcm2Tree()
 {
-    cout << Node::nodesById.size() << '\n';
-
-    map<size_t, Node*>::iterator it;
-    for (it = Node::nodesById.begin(); it != Node::nodesById.end(); ++it)
-        cout << it->second->name << ' ' << it->first << '\n';
+    outputAcmNodes();
 
-    for (it = Node::nodesById.begin(); it != Node::nodesById.end(); ++it)
+    for (NodeId id = 0; id < tree.nameBegin.size(); id++)
     {
-        Node* parent = it->second->parent;
-        if (parent)
-            cout << parent->id << '\n';
+        if (!tree.contains(id))
+            continue;
+
+        if (tree.parent[id] != NONE)
+            out.putNumber(tree.parent[id]);
         else
-            cout << -1 << '\n';
+            out.put("-1");
+        out.put('\n');
     }
 }
 
 void outputAcm3Tree()
 {
-    cout << Node::nodesById.size() << '\n';
-
-    map<size_t, Node*>::iterator it;
-    for (it = Node::nodesById.begin(); it != Node::nodesById.end(); ++it)
-        cout << it->second->name << ' ' << it->first << '\n';
+    outputAcmNodes();
 
-    for (it = Node::nodesById.begin(); it != Node::nodesById.end(); ++it)
-    {
-        Node* parent = it->second;
-        Node* child = parent->rChild;
-        while (child)
+    for (NodeId id = 0; id < tree.nameBegin.size(); id++)
+        for (NodeId child = tree.firstChild[id]; child != NONE;
+             child = tree.nextSibling[child])
         {
-            cout << parent->id << ' ' << child->id << '\n';
-            child = child->lSibling;
+            out.putNumber(id);
+            out.put(' ');
+            out.putNumber(child);
+            out.put('\n');
         }
-    }
 }
 
 void outputXmlTree()
 {
-    const string space = "  ";
+    const string_view space = "  ";
 
     size_t lastDepth = 0;
-    Node* node = Node::nodesById[0];
-    do
+    auto closeDirs = [&space, &lastDepth](size_t depth)
     {
-        while (lastDepth > node->depth)
+        while (lastDepth > depth)
         {
             for (size_t i = 0; i < lastDepth - 1; i++)
-                cout << space;
-            cout << "</dir>\n";
+                out.put(space);
+            out.put("</dir>\n");
             lastDepth--;
         }
+    };
+    tree.preorder([&](NodeId node, size_t depth)
+    {
+        closeDirs(depth);
 
-        for (size_t i = 0; i < node->depth; i++)
-            cout << space;
-
-        if (node->rChild)
-            cout << "<dir name=\'" << node->name
-                 << "\' id=\'" << node->id << "\'>\n";
-        else
-            cout << "<file name=\'" << node->name
-                 << "\' id=\'" << node->id << "\'/>\n";
+        for (size_t i = 0; i < depth; i++)
+            out.put(space);
 
-        lastDepth = node->depth;
-    } while ((node = node->pythonNext()));
+        bool dir = tree.firstChild[node] != NONE;
+        out.put(dir ? "<dir name=\'" : "<file name=\'");
+        out.put(tree.name(node));
+        out.put("\' id=\'");
+        out.putNumber(node);
+        out.put(dir ? "\'>\n" : "\'/>\n");
 
-    while (lastDepth > 0)
-    {
-        for (size_t i = 0; i < lastDepth - 1; i++)
-            cout << space;
-        cout << "</dir>\n";
-        lastDepth--;
-    }
+        lastDepth = depth;
+    });
+    closeDirs(0);
 }
 
 int main()
 {
-    string inFormat, outFormat;
-    cin >> inFormat >> outFormat;
+    if (!in.open())
+        return 1;
+    tree.names = in.all();
+
+    string_view inFormat = in.token();
+    string_view outFormat = in.token();
 
     // Build tree from input.
     if (inFormat == "find")
@@ -540,5 +721,5 @@ int main()
     else if (outFormat == "xml")
         outputXmlTree();
 
-    Node::deleteTree();
+    out.flush();
 }
@@ -3,53 +3,860 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cstdint>
+#include <cstring>
 #include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "huffman_codebook.h"
+#include "tans_codebook.h"
 
 using namespace std;
+using namespace huffman;
+
+// Header: magic, original size (8 bytes, little endian), code lengths.
+const char MAGIC[4] = { 'H', 'U', 'F', '1' };
+const size_t HEADER_SIZE = sizeof( MAGIC ) + 8 + ALPHABET;
+// Block container: magic, original size, block size, block count, code
+// lengths, tANS counts (16-bit little endian, all 0 if unused), then
+// block count + 1 offsets of the compressed blocks relative to the end
+// of the index, the last one being the total size. Every block starts
+// with the byte of its backend.
+const char BLOCK_MAGIC[4] = { 'H', 'U', 'F', 'B' };
+const size_t BLOCK_HEADER_SIZE = sizeof( BLOCK_MAGIC ) + 3 * 8
+                               + HuffmanCodebook::SERIALIZED_SIZE
+                               + tans::TansCodebook::SERIALIZED_SIZE;
+const uint8_t BLOCK_HUFFMAN = 0;
+const uint8_t BLOCK_TANS = 1;
+// Huffman decodes faster, so the auto backend takes tANS for a block
+// only if that saves at least this part of its size.
+const double TANS_MIN_GAIN = 1.0 / 32;
+// Adaptive stream: magic and the code length limit, then frames of
+// (raw size, coded size) as 32-bit little endian numbers followed by
+// the coded chunk. A frame with raw size 0 ends the stream.
+const char STREAM_MAGIC[4] = { 'H', 'U', 'F', 'S' };
+// Once the model has seen this many bytes its counts are halved, so
+// older data weighs less and the counts stay bounded.
+const uint64_t ADAPT_LIMIT = uint64_t( 1 ) << 22;
+// Coded chunks are read at most this many bytes at a time.
+const size_t STREAM_PIECE = size_t( 1 ) << 20;
+
+struct Options
+{
+    Options() : mode( "codes" ), hist( "binary" ), backend( "huffman" ),
+                max_length( 0 ), threads( 1 ), block_size( 0 ),
+                chunk_size( 0 ), offset( 0 ), length( SIZE_MAX ),
+                format( "csv" ),
+                bench_size( size_t( 16 ) << 20 ), repeat( 3 ) {}
+
+    string in, out, mode, hist;
+    string backend;             // Block coder: huffman, tans or auto.
+    unsigned max_length;
+    unsigned threads;
+    size_t block_size;          // 0 - single stream file.
+    size_t chunk_size;          // Adaptive stream rebuild interval.
+    size_t offset, length;      // Range to decode from a block file.
+    string format;              // Benchmark report: csv or json.
+    size_t bench_size;          // Bytes of each synthetic benchmark input.
+    unsigned repeat;            // Benchmark runs, the best one counts.
+};
 
 static void usage( const string& path )
 {
     string program_name = path.substr( path.rfind( '\\' ) + 1 );
-    cout << "Usage: " << program_name << " --in=name --out=name\n"
+    cout << "Usage: " << program_name << " --in=name --out=name [--mode=name]\n"
          << "   --in     name of the input file, e.g. input.txt\n"
          << "   --out    name of the output file, e.g. output.txt\n"
+         << "   --mode   codes  - read symbol frequencies, print their codes\n"
+         << "                     (default)\n"
+         << "            encode - compress any file\n"
+         << "            decode - decompress a file made by encode\n"
+         << "            lengths - read a large histogram, write one code\n"
+         << "                     length byte per symbol\n"
+         << "            bench  - time codebook builds, encoding and decoding\n"
+         << "                     on synthetic data and the --in files (comma\n"
+         << "                     separated); --out=- prints the report\n"
+         << "   --hist   histogram format for lengths mode:\n"
+         << "            binary - little endian 64-bit counts (default)\n"
+         << "            text   - the same format as in codes mode\n"
+         << "   --max-len  longest allowed code for encode and lengths modes,\n"
+         << "            e.g. 11 to decode every symbol with one lookup\n"
+         << "   --threads  worker threads for encode and decode, 0 - all cores\n"
+         << "   --block-size  split the input into independently coded\n"
+         << "            blocks, e.g. 4M; implied by --threads and --backend\n"
+         << "   --backend  coder of the blocks: huffman (default), tans for\n"
+         << "            skewed data, or auto to pick per block the smaller,\n"
+         << "            preferring the faster huffman on a near tie\n"
+         << "   --offset, --length  decode only this range of the original\n"
+         << "            data from a block file\n"
+         << "   --stream  encode in one pass with bounded memory, rebuilding\n"
+         << "            the code after every chunk of this size, e.g. 64K;\n"
+         << "            --in and --out may be - for stdin and stdout\n"
+         << "   --format  bench report format, csv (default) or json\n"
+         << "   --bench-size  size of each synthetic bench input, default 16M\n"
+         << "   --repeat  bench runs per measurement, the best one counts\n"
+         << "            (bench also times batches of per-block codebooks\n"
+         << "            for block sizes 4K to 1M, or just --block-size)\n"
          << "Example:\n   "
-         << program_name << " --in=input.txt --out=output.txt";
+         << program_name << " --in=input.txt --out=output.txt\n   "
+         << program_name << " --in=log.txt --out=log.huf --mode=encode\n   "
+         << program_name << " --in=dump --out=dump.huf --mode=encode --threads=0\n   "
+         << program_name << " --in=- --out=- --mode=encode --stream=64K\n   "
+         << program_name << " --in=metrics --out=metrics.huf --mode=encode --backend=auto\n   "
+         << program_name << " --in=a.log,b.log --out=bench.json --mode=bench --format=json\n   "
+         << program_name << " --in=vocab.bin --out=vocab.len --mode=lengths";
 }
 
-int main( int argc, char* argv[] )
+static double seconds_since( chrono::steady_clock::time_point start )
 {
-    string in, out;
-    if ( argc == 1 ) {
-        in = "input.txt";
-        out = "output.txt";
-    } else if ( argc != 3 ) {
-        usage( argv[0] );
+    return chrono::duration<double>( chrono::steady_clock::now() - start )
+        .count();
+}
+
+static bool read_file( const string& name, vector<uint8_t>& data )
+{
+    ifstream file( name, ios_base::in | ios_base::binary );
+    if ( !file )
+        return false;
+    file.seekg( 0, ios_base::end );
+    data.resize( size_t( file.tellg() ) );
+    file.seekg( 0, ios_base::beg );
+    file.read( reinterpret_cast<char*>( data.data() ), data.size() );
+    return bool( file ) || data.empty();
+}
+
+static bool write_file( const string& name, const vector<uint8_t>& data )
+{
+    ofstream file( name, ios_base::out | ios_base::binary );
+    if ( !file )
+        return false;
+    file.write( reinterpret_cast<const char*>( data.data() ), data.size() );
+    return bool( file );
+}
+
+// Read-only mapping of a whole file.
+struct MappedFile
+{
+    MappedFile() : data( 0 ), size( 0 ) {}
+    ~MappedFile();
+
+    bool open( const string& name );
+
+    const uint8_t* data;
+    size_t size;
+};
+
+MappedFile::~MappedFile()
+{
+    if ( size > 0 )
+        munmap( const_cast<uint8_t*>( data ), size );
+}
+
+bool MappedFile::open( const string& name )
+{
+    int fd = ::open( name.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        return false;
+    struct stat st;
+    bool ok = fstat( fd, &st ) == 0;
+    if ( ok && st.st_size > 0 ) {
+        void* p = mmap( 0, size_t( st.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+        ok = p != MAP_FAILED;
+        if ( ok ) {
+            data = static_cast<const uint8_t*>( p );
+            size = size_t( st.st_size );
+        }
+    }
+    close( fd );
+    return ok;
+}
+
+// Runs task( worker, i ) for every i < count on a pool of threads.
+// Workers take indices from a shared counter, so uneven items balance.
+template <class Task>
+static void parallel_for( size_t count, unsigned threads, Task task )
+{
+    threads = unsigned( min<size_t>( max( threads, 1u ), count ) );
+    atomic<size_t> next( 0 );
+    auto worker = [&]( unsigned id ) {
+        for ( size_t i; ( i = next.fetch_add( 1 ) ) < count; )
+            task( id, i );
+    };
+    vector<thread> pool;
+    for ( unsigned id = 1; id < threads; id++ )
+        pool.push_back( thread( worker, id ) );
+    worker( 0 );
+    for ( size_t i = 0; i < pool.size(); i++ )
+        pool[i].join();
+}
+
+// Reports how much the length limit costs against the unconstrained
+// code, both given as total bits.
+static void report_length_limit( double unlimited_bits, double bits,
+                                 double total )
+{
+    if ( total == 0 )
+        return;
+    cout << "unconstrained average code length: " << unlimited_bits / total
+         << "\n";
+    cout << "average code length increase: "
+         << ( bits - unlimited_bits ) / total << " bits ("
+         << ( unlimited_bits > 0
+              ? ( bits - unlimited_bits ) / unlimited_bits * 100 : 0 )
+         << "%)\n";
+}
+
+static int encode_block_file( const Options& opt );
+
+static int encode_stream( const Options& opt );
+
+static int encode_file( const Options& opt )
+{
+    if ( opt.chunk_size > 0 )
+        return encode_stream( opt );
+    if ( opt.block_size > 0 )
+        return encode_block_file( opt );
+
+    const string& in = opt.in;
+    const string& out = opt.out;
+    unsigned max_length = opt.max_length;
+    vector<uint8_t> data;
+    if ( !read_file( in, data ) ) {
+        cout << "File " << in << " does not exist.";
         return 0;
-    } else {
-        for ( size_t i = 1; i <= 2; i++ ) {
-            string arg = argv[i];
-            size_t pos = arg.find( '=' );
-            if ( pos == string::npos ) {
-                usage( argv[0] );
-                return 0;
-            }
-            string param = arg.substr( 0, pos );
-            if ( param == "--in" )
-                in = arg.substr( pos + 1 );
-            else if ( param == "--out" )
-                out = arg.substr( pos + 1 );
-            else {
-                usage( argv[0]     );
-                return 0;
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<uint64_t> freq( ALPHABET, 0 );
+    histogram( data.data(), data.size(), freq.data() );
+    HuffmanCodebook book;
+    double unlimited_bits;
+    if ( !book.build( freq.data(), max_length, &unlimited_bits ) ) {
+        cout << "Maximum code length " << max_length << " is too short.";
+        return 0;
+    }
+
+    vector<uint8_t> packed( HEADER_SIZE
+                            + payload_bound( data.size(), book.max_length() ) );
+    memcpy( packed.data(), MAGIC, sizeof( MAGIC ) );
+    put_le64( packed.data() + sizeof( MAGIC ), data.size() );
+    book.serialize( packed.data() + sizeof( MAGIC ) + 8 );
+    size_t payload = book.encode( data.data(), data.size(),
+                                  packed.data() + HEADER_SIZE );
+    packed.resize( HEADER_SIZE + payload );
+    double elapsed = seconds_since( start );
+
+    if ( !write_file( out, packed ) ) {
+        cout << "File " << out << " cannot be written.";
+        return 0;
+    }
+    cout << "encoded " << data.size() << " bytes into " << packed.size()
+         << " bytes\n";
+    cout << "bits per symbol: "
+         << ( data.empty() ? 0 : payload * 8.0 / data.size() ) << "\n";
+    cout << "speed: " << data.size() / 1e6 / max( elapsed, 1e-9 )
+         << " MB/s\n";
+    double bits = 0;
+    for ( size_t i = 0; i < ALPHABET; i++ )
+        bits += double( freq[i] ) * book.length( uint8_t( i ) );
+    if ( bits > unlimited_bits )
+        report_length_limit( unlimited_bits, bits, double( data.size() ) );
+    return 0;
+}
+
+static int decode_block_file( const Options& opt, vector<uint8_t>& packed );
+
+static bool has_magic( const string& name, const char magic[4] )
+{
+    ifstream file( name, ios_base::in | ios_base::binary );
+    char head[4];
+    return file.read( head, 4 ) && memcmp( head, magic, 4 ) == 0;
+}
+
+static int decode_stream( const Options& opt );
+
+static int decode_file( const Options& opt )
+{
+    if ( opt.in == "-" || has_magic( opt.in, STREAM_MAGIC ) )
+        return decode_stream( opt );
+
+    const string& in = opt.in;
+    const string& out = opt.out;
+    vector<uint8_t> packed;
+    if ( !read_file( in, packed ) ) {
+        cout << "File " << in << " does not exist.";
+        return 0;
+    }
+    if ( packed.size() >= BLOCK_HEADER_SIZE
+         && memcmp( packed.data(), BLOCK_MAGIC, sizeof( BLOCK_MAGIC ) ) == 0 )
+        return decode_block_file( opt, packed );
+    if ( opt.offset != 0 || opt.length != SIZE_MAX ) {
+        cout << "Only block files can be decoded partially.";
+        return 0;
+    }
+    if ( packed.size() < HEADER_SIZE
+         || memcmp( packed.data(), MAGIC, sizeof( MAGIC ) ) != 0 ) {
+        cout << "File " << in << " is not a compressed file.";
+        return 0;
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t n = size_t( get_le64( packed.data() + sizeof( MAGIC ) ) );
+    HuffmanCodebook book;
+    if ( !book.deserialize( packed.data() + sizeof( MAGIC ) + 8 ) ) {
+        cout << "File " << in << " has a broken header.";
+        return 0;
+    }
+    // Every code is at least a bit long, which bounds n before it is
+    // allocated.
+    size_t payload = packed.size() - HEADER_SIZE;
+    if ( n / 8 > payload ) {
+        cout << "File " << in << " is corrupted.";
+        return 0;
+    }
+    packed.resize( packed.size() + PAYLOAD_PADDING, 0 );
+    vector<uint8_t> data( n );
+    if ( !book.decode( packed.data() + HEADER_SIZE, payload,
+                       data.data(), n ) ) {
+        cout << "File " << in << " is corrupted.";
+        return 0;
+    }
+    double elapsed = seconds_since( start );
+
+    if ( !write_file( out, data ) ) {
+        cout << "File " << out << " cannot be written.";
+        return 0;
+    }
+    cout << "decoded " << n << " bytes\n";
+    cout << "speed: " << n / 1e6 / max( elapsed, 1e-9 ) << " MB/s\n";
+    return 0;
+}
+
+// Block file: every block is coded on its own with the shared codebooks
+// of the whole input, so blocks can be decoded in parallel or alone.
+// Both backends are built from the same histogram; with --backend=auto
+// each block is costed against both from its own counts.
+static int encode_block_file( const Options& opt )
+{
+    vector<uint8_t> data;
+    if ( !read_file( opt.in, data ) ) {
+        cout << "File " << opt.in << " does not exist.";
+        return 0;
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t block_size = opt.block_size;
+    size_t blocks = ( data.size() + block_size - 1 ) / block_size;
+
+    // Per-thread histograms, merged once all blocks are counted.
+    vector< vector<uint64_t> > partial( max( opt.threads, 1u ),
+                                        vector<uint64_t>( ALPHABET, 0 ) );
+    parallel_for( blocks, opt.threads, [&]( unsigned worker, size_t b ) {
+        size_t first = b * block_size;
+        size_t n = min( block_size, data.size() - first );
+        histogram( data.data() + first, n, partial[worker].data() );
+    } );
+    vector<uint64_t> freq( ALPHABET, 0 );
+    for ( size_t t = 0; t < partial.size(); t++ )
+        for ( size_t i = 0; i < ALPHABET; i++ )
+            freq[i] += partial[t][i];
+
+    HuffmanCodebook book;
+    if ( !book.build( freq.data(), opt.max_length ) ) {
+        cout << "Maximum code length " << opt.max_length << " is too short.";
+        return 0;
+    }
+    tans::TansCodebook tans_book;
+    bool use_tans = opt.backend != "huffman" && tans_book.build( freq.data() );
+    double tans_cost[ ALPHABET ];
+    for ( size_t i = 0; i < ALPHABET && use_tans; i++ )
+        tans_cost[i] = freq[i] > 0 ? tans_book.cost( uint8_t( i ) ) : 0;
+
+    vector< vector<uint8_t> > coded( blocks );
+    atomic<size_t> tans_blocks( 0 );
+    parallel_for( blocks, opt.threads, [&]( unsigned, size_t b ) {
+        size_t first = b * block_size;
+        size_t n = min( block_size, data.size() - first );
+        bool with_tans = use_tans && opt.backend == "tans";
+        if ( use_tans && opt.backend == "auto" ) {
+            uint64_t count[ ALPHABET ] = {};
+            histogram( data.data() + first, n, count );
+            double huffman_bits = 0, tans_bits = 0;
+            for ( size_t i = 0; i < ALPHABET; i++ ) {
+                huffman_bits += double( count[i] )
+                              * book.length( uint8_t( i ) );
+                tans_bits += double( count[i] ) * tans_cost[i];
             }
+            with_tans = tans_bits < huffman_bits * ( 1 - TANS_MIN_GAIN );
         }
+        coded[b].resize( 1 + max( payload_bound( n, book.max_length() ),
+                                  tans::payload_bound( n ) ) );
+        uint8_t* out = coded[b].data();
+        out[0] = with_tans ? BLOCK_TANS : BLOCK_HUFFMAN;
+        size_t size = with_tans
+            ? tans_book.encode( data.data() + first, n, out + 1 )
+            : book.encode( data.data() + first, n, out + 1 );
+        coded[b].resize( 1 + size );
+        tans_blocks += with_tans;
+    } );
+
+    size_t index_size = ( blocks + 1 ) * 8;
+    size_t payload = 0;
+    for ( size_t b = 0; b < blocks; b++ )
+        payload += coded[b].size();
+    vector<uint8_t> packed( BLOCK_HEADER_SIZE + index_size + payload );
+    uint8_t* p = packed.data();
+    memcpy( p, BLOCK_MAGIC, sizeof( BLOCK_MAGIC ) );
+    p += sizeof( BLOCK_MAGIC );
+    put_le64( p, data.size() );
+    put_le64( p + 8, block_size );
+    put_le64( p + 16, blocks );
+    book.serialize( p + 24 );
+    p += 24 + HuffmanCodebook::SERIALIZED_SIZE;
+    if ( use_tans )
+        tans_book.serialize( p );
+    p += tans::TansCodebook::SERIALIZED_SIZE;
+    uint8_t* body = p + index_size;
+    size_t offset = 0;
+    for ( size_t b = 0; b < blocks; b++ ) {
+        put_le64( p + 8 * b, offset );
+        memcpy( body + offset, coded[b].data(), coded[b].size() );
+        offset += coded[b].size();
     }
-    if ( in == out ) {
-        cout << "Input and output files must be different.";
+    put_le64( p + 8 * blocks, offset );
+    double elapsed = seconds_since( start );
+
+    if ( !write_file( opt.out, packed ) ) {
+        cout << "File " << opt.out << " cannot be written.";
         return 0;
     }
+    cout << "encoded " << data.size() << " bytes into " << packed.size()
+         << " bytes (" << blocks << " blocks, " << tans_blocks
+         << " coded with tANS)\n";
+    cout << "bits per symbol: "
+         << ( data.empty() ? 0 : payload * 8.0 / data.size() ) << "\n";
+    cout << "speed: " << data.size() / 1e6 / max( elapsed, 1e-9 )
+         << " MB/s\n";
+    return 0;
+}
+
+static int decode_block_file( const Options& opt, vector<uint8_t>& packed )
+{
+    auto start = chrono::steady_clock::now();
+    const uint8_t* p = packed.data() + sizeof( BLOCK_MAGIC );
+    size_t n = size_t( get_le64( p ) );
+    size_t block_size = size_t( get_le64( p + 8 ) );
+    size_t blocks = size_t( get_le64( p + 16 ) );
+    HuffmanCodebook book;
+    size_t index_size = packed.size() - BLOCK_HEADER_SIZE;
+    if ( block_size == 0
+         || blocks != n / block_size + ( n % block_size != 0 )
+         || index_size / 8 <= blocks
+         || !book.deserialize( p + 24 ) ) {
+        cout << "File " << opt.in << " has a broken header.";
+        return 0;
+    }
+    // The counts are all 0 if no block uses tANS.
+    tans::TansCodebook tans_book;
+    bool has_tans = tans_book.deserialize( p + 24
+                                           + HuffmanCodebook::SERIALIZED_SIZE );
+    // Every block must lie inside the body and hold no more symbols than
+    // its backend can code in its size, so n is known to fit the file
+    // before anything is allocated.
+    const uint8_t* index = packed.data() + BLOCK_HEADER_SIZE;
+    size_t body = BLOCK_HEADER_SIZE + ( blocks + 1 ) * 8;
+    bool valid = get_le64( index ) <= packed.size() - body;
+    for ( size_t b = 0; b < blocks && valid; b++ ) {
+        uint64_t begin = get_le64( index + 8 * b );
+        uint64_t end = get_le64( index + 8 * ( b + 1 ) );
+        size_t count = min( block_size, n - b * block_size );
+        valid = begin < end && end <= packed.size() - body;
+        if ( !valid )
+            break;
+        size_t size = size_t( end - begin - 1 );
+        uint8_t backend = packed[ body + begin ];
+        if ( backend == BLOCK_TANS )
+            valid = has_tans && count <= tans_book.max_symbols( size );
+        else
+            valid = backend == BLOCK_HUFFMAN && count / 8 <= size;
+    }
+    if ( !valid ) {
+        cout << "File " << opt.in << " is corrupted.";
+        return 0;
+    }
+
+    // Only the blocks overlapping the requested range are decoded.
+    size_t from = min( opt.offset, n );
+    size_t to = from + min( opt.length, n - from );
+    size_t first_block = from / block_size;
+    size_t last_block = to > from ? ( to - 1 ) / block_size + 1 : first_block;
+
+    packed.resize( packed.size() + PAYLOAD_PADDING, 0 );
+    index = packed.data() + BLOCK_HEADER_SIZE;
+    const uint8_t* payload = packed.data() + body;
+    size_t last_end = last_block == blocks ? n : last_block * block_size;
+    vector<uint8_t> data( last_end - first_block * block_size );
+    atomic<bool> corrupted( false );
+    parallel_for( last_block - first_block, opt.threads,
+                  [&]( unsigned, size_t i ) {
+        size_t b = first_block + i;
+        size_t begin = size_t( get_le64( index + 8 * b ) );
+        size_t end = size_t( get_le64( index + 8 * ( b + 1 ) ) );
+        size_t count = min( block_size, n - b * block_size );
+        uint8_t backend = payload[ begin ];
+        uint8_t* dst = data.data() + i * block_size;
+        bool ok;
+        if ( backend == BLOCK_TANS )
+            ok = has_tans && tans_book.decode( payload + begin + 1,
+                                               end - begin - 1, dst, count );
+        else
+            ok = backend == BLOCK_HUFFMAN
+                && book.decode( payload + begin + 1, end - begin - 1,
+                                dst, count );
+        if ( !ok )
+            corrupted = true;
+    } );
+    if ( corrupted ) {
+        cout << "File " << opt.in << " is corrupted.";
+        return 0;
+    }
+    size_t skip = to > from ? from - first_block * block_size : 0;
+    data.erase( data.begin(), data.begin() + skip );
+    data.resize( to - from );
+    double elapsed = seconds_since( start );
+
+    if ( !write_file( opt.out, data ) ) {
+        cout << "File " << opt.out << " cannot be written.";
+        return 0;
+    }
+    cout << "decoded " << data.size() << " bytes ("
+         << last_block - first_block << " of " << blocks << " blocks)\n";
+    cout << "speed: " << data.size() / 1e6 / max( elapsed, 1e-9 )
+         << " MB/s\n";
+    return 0;
+}
+
+// Symbol statistics both ends of a stream keep in lockstep: each chunk
+// is coded with the codebook built from all chunks before it, so no
+// code lengths are transmitted. Counts start at 1, so every byte has a
+// code from the beginning, which takes a limit of at least 8 bits;
+// update( 0, 0 ) builds that first codebook.
+struct AdaptiveModel
+{
+    AdaptiveModel( unsigned max_length );
+
+    // False if no codebook meets max_length.
+    bool update( const uint8_t* data, size_t n );
 
+    vector<uint64_t> freq;
+    uint64_t seen;
+    unsigned max_length;
+    HuffmanCodebook book;
+    LengthScratch scratch;      // Reused by every rebuild.
+};
+
+AdaptiveModel::AdaptiveModel( unsigned max_length )
+    : freq( ALPHABET, 1 ), seen( 0 ), max_length( max_length )
+{
+}
+
+bool AdaptiveModel::update( const uint8_t* data, size_t n )
+{
+    histogram( data, n, freq.data() );
+    seen += n;
+    if ( seen >= ADAPT_LIMIT ) {
+        for ( size_t i = 0; i < ALPHABET; i++ )
+            freq[i] = ( freq[i] + 1 ) / 2;
+        seen = 0;
+    }
+    return book.build( freq.data(), scratch, max_length );
+}
+
+static FILE* open_stream( const string& name, bool input )
+{
+    if ( name == "-" )
+        return input ? stdin : stdout;
+    return fopen( name.c_str(), input ? "rb" : "wb" );
+}
+
+static void close_stream( FILE* file )
+{
+    if ( file != stdin && file != stdout )
+        fclose( file );
+    else
+        fflush( file );
+}
+
+static void put_le32( uint8_t* p, uint32_t v )
+{
+    for ( size_t i = 0; i < 4; i++ )
+        p[i] = uint8_t( v >> ( 8 * i ) );
+}
+
+static uint32_t get_le32( const uint8_t* p )
+{
+    return uint32_t( p[0] ) | uint32_t( p[1] ) << 8
+         | uint32_t( p[2] ) << 16 | uint32_t( p[3] ) << 24;
+}
+
+static int encode_stream( const Options& opt )
+{
+    // Statistics must not mix with the data written to stdout.
+    ostream& log = opt.out == "-" ? cerr : cout;
+    FILE* in = open_stream( opt.in, true );
+    if ( !in ) {
+        log << "File " << opt.in << " does not exist.";
+        return 0;
+    }
+    auto start = chrono::steady_clock::now();
+    AdaptiveModel model( opt.max_length );
+    if ( !model.update( 0, 0 ) ) {
+        close_stream( in );
+        log << "Maximum code length " << opt.max_length << " is too short.";
+        return 0;
+    }
+    FILE* out = open_stream( opt.out, false );
+    if ( !out ) {
+        close_stream( in );
+        log << "File " << opt.out << " cannot be written.";
+        return 0;
+    }
+
+    size_t chunk = min<size_t>( opt.chunk_size, UINT32_MAX / MAX_CODE_LENGTH );
+    vector<uint8_t> raw( chunk );
+    vector<uint8_t> coded( 8 + payload_bound( chunk, MAX_CODE_LENGTH ) );
+    uint64_t total_in = 0, total_out = 0;
+
+    uint8_t header[5];
+    memcpy( header, STREAM_MAGIC, sizeof( STREAM_MAGIC ) );
+    header[4] = uint8_t( opt.max_length );
+    bool ok = fwrite( header, 1, sizeof( header ), out ) == sizeof( header );
+    total_out += sizeof( header );
+    while ( ok ) {
+        size_t n = fread( raw.data(), 1, chunk, in );
+        size_t size = n > 0 ? model.book.encode( raw.data(), n,
+                                                 coded.data() + 8 ) : 0;
+        put_le32( coded.data(), uint32_t( n ) );
+        put_le32( coded.data() + 4, uint32_t( size ) );
+        ok = fwrite( coded.data(), 1, 8 + size, out ) == 8 + size;
+        total_in += n;
+        total_out += 8 + size;
+        if ( n == 0 )
+            break;
+        if ( !model.update( raw.data(), n ) ) {
+            log << "Maximum code length " << opt.max_length << " is too short.";
+            close_stream( in );
+            close_stream( out );
+            return 0;
+        }
+    }
+    close_stream( in );
+    close_stream( out );
+    double elapsed = seconds_since( start );
+
+    if ( !ok ) {
+        log << "File " << opt.out << " cannot be written.";
+        return 0;
+    }
+    log << "encoded " << total_in << " bytes into " << total_out
+        << " bytes\n";
+    log << "speed: " << total_in / 1e6 / max( elapsed, 1e-9 ) << " MB/s\n";
+    return 0;
+}
+
+static int decode_stream( const Options& opt )
+{
+    ostream& log = opt.out == "-" ? cerr : cout;
+    FILE* in = open_stream( opt.in, true );
+    if ( !in ) {
+        log << "File " << opt.in << " does not exist.";
+        return 0;
+    }
+    uint8_t header[5];
+    if ( fread( header, 1, sizeof( header ), in ) != sizeof( header )
+         || memcmp( header, STREAM_MAGIC, sizeof( STREAM_MAGIC ) ) != 0
+         || header[4] > MAX_CODE_LENGTH ) {
+        close_stream( in );
+        log << "File " << opt.in << " is not a compressed stream.";
+        return 0;
+    }
+    FILE* out = open_stream( opt.out, false );
+    if ( !out ) {
+        close_stream( in );
+        log << "File " << opt.out << " cannot be written.";
+        return 0;
+    }
+
+    auto start = chrono::steady_clock::now();
+    AdaptiveModel model( header[4] );
+    vector<uint8_t> raw, coded;
+    uint64_t total = 0;
+    // The encoder writes no stream its limit cannot code.
+    const char* error = model.update( 0, 0 ) ? 0 : " is corrupted.";
+    while ( !error ) {
+        uint8_t frame[8];
+        if ( fread( frame, 1, sizeof( frame ), in ) != sizeof( frame ) ) {
+            error = " is truncated.";
+            break;
+        }
+        size_t n = get_le32( frame );
+        size_t size = get_le32( frame + 4 );
+        if ( n == 0 )
+            break;
+        // Every code is at least a bit long.
+        if ( size > payload_bound( n, MAX_CODE_LENGTH ) || n / 8 > size ) {
+            error = " is corrupted.";
+            break;
+        }
+        // The payload is read in pieces, so a corrupt size cannot
+        // allocate more than the stream actually holds.
+        size_t got = 0;
+        while ( got < size ) {
+            size_t piece = min( size - got, STREAM_PIECE );
+            coded.resize( got + piece );
+            if ( fread( coded.data() + got, 1, piece, in ) != piece )
+                break;
+            got += piece;
+        }
+        if ( got != size ) {
+            error = " is truncated.";
+            break;
+        }
+        coded.resize( size + PAYLOAD_PADDING );
+        raw.resize( n );
+        if ( !model.book.decode( coded.data(), size, raw.data(), n ) )
+            error = " is corrupted.";
+        else if ( fwrite( raw.data(), 1, n, out ) != n ) {
+            log << "File " << opt.out << " cannot be written.";
+            close_stream( in );
+            close_stream( out );
+            return 0;
+        }
+        total += n;
+        if ( !model.update( raw.data(), n ) )
+            error = " is corrupted.";
+    }
+    close_stream( in );
+    close_stream( out );
+    double elapsed = seconds_since( start );
+
+    if ( error ) {
+        log << "File " << opt.in << error;
+        return 0;
+    }
+    log << "decoded " << total << " bytes\n";
+    log << "speed: " << total / 1e6 / max( elapsed, 1e-9 ) << " MB/s\n";
+    return 0;
+}
+
+// Text histogram: the symbol count followed by the frequencies.
+static bool parse_text_histogram( const MappedFile& file,
+                                  vector<uint64_t>& freq )
+{
+    const uint8_t* p = file.data;
+    const uint8_t* end = file.data + file.size;
+    bool have_count = false;
+    size_t n = 0;
+    while ( p < end ) {
+        while ( p < end && ( *p < '0' || *p > '9' ) )
+            p++;
+        if ( p == end )
+            break;
+        uint64_t v = 0;
+        while ( p < end && *p >= '0' && *p <= '9' )
+            v = v * 10 + ( *p++ - '0' );
+        if ( !have_count ) {
+            n = size_t( v );
+            freq.reserve( n );
+            have_count = true;
+        } else if ( freq.size() < n )
+            freq.push_back( v );
+    }
+    return have_count && freq.size() == n;
+}
+
+static int build_lengths_file( const string& in, const string& out,
+                               const string& hist, unsigned max_length )
+{
+    MappedFile file;
+    if ( !file.open( in ) ) {
+        cout << "File " << in << " does not exist.";
+        return 0;
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<uint64_t> parsed;
+    const uint64_t* freq;
+    size_t n;
+    if ( hist == "text" ) {
+        if ( !parse_text_histogram( file, parsed ) ) {
+            cout << "File " << in << " is not a histogram.";
+            return 0;
+        }
+        freq = parsed.data();
+        n = parsed.size();
+    } else {
+        if ( file.size % 8 != 0 ) {
+            cout << "File " << in << " is not a histogram.";
+            return 0;
+        }
+        // Counts are little endian, just like the machines we run on.
+        freq = reinterpret_cast<const uint64_t*>( file.data );
+        n = file.size / 8;
+    }
+    double load_time = seconds_since( start );
+
+    start = chrono::steady_clock::now();
+    vector<uint8_t> lengths( n );
+    double unlimited_bits;
+    unsigned longest = build_code_lengths( freq, n, lengths.data(),
+                                           max_length, &unlimited_bits );
+    double build_time = seconds_since( start );
+    if ( longest == 0 && unlimited_bits > 0 ) {
+        cout << "Maximum code length " << max_length << " is too short.";
+        return 0;
+    }
+
+    if ( !write_file( out, lengths ) ) {
+        cout << "File " << out << " cannot be written.";
+        return 0;
+    }
+
+    double total = 0, bits = 0, entropy = 0;
+    size_t used = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( freq[i] == 0 )
+            continue;
+        used++;
+        total += freq[i];
+        bits += double( freq[i] ) * lengths[i];
+    }
+    for ( size_t i = 0; i < n; i++ )
+        if ( freq[i] > 0 )
+            entropy -= freq[i] * log2( freq[i] / total );
+    cout << "symbols: " << n << " (" << used << " used)\n";
+    cout << "longest code: " << longest << "\n";
+    cout << "average code length: " << ( total > 0 ? bits / total : 0 ) << "\n";
+    cout << "entropy: " << ( total > 0 ? entropy / total : 0 ) << "\n";
+    if ( max_length > 0 )
+        report_length_limit( unlimited_bits, bits, total );
+    cout << "load time: " << load_time * 1000 << " ms\n";
+    cout << "build time: " << build_time * 1000 << " ms\n";
+    return 0;
+}
+
+static int print_codes( const string& in, const string& out )
+{
     fstream file( in, ios_base::in );
     if ( !file ) {
         cout << "File " << in << " does not exist.";
@@ -124,4 +931,516 @@ int main( int argc, char* argv[] )
     cout << "redundance coefficient: " << redundance_coeff << "\n";
 
     file.close();
+    return 0;
+}
+
+// One line of the benchmark report.
+struct BenchResult
+{
+    BenchResult() : symbols( 0 ), bytes( 0 ), build_ms( 0 ),
+                    encode_mbps( 0 ), decode_mbps( 0 ), ratio( 0 ),
+                    avg_code_length( 0 ), entropy( 0 ),
+                    redundance_coeff( 0 ), block_size( 0 ),
+                    builds_per_sec( 0 ) {}
+
+    string test, source;
+    size_t symbols, bytes;
+    double build_ms, encode_mbps, decode_mbps, ratio;
+    double avg_code_length, entropy, redundance_coeff;
+    size_t block_size;          // Batch builds: one codebook per block.
+    double builds_per_sec;
+};
+
+// Fills the code statistics the codes mode prints, for a histogram and
+// the bits each symbol costs, e.g. its code length.
+template <class Cost>
+static void code_statistics( const uint64_t* freq, size_t n, Cost cost,
+                             BenchResult& r )
+{
+    double total = 0, bits = 0, entropy = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        total += freq[i];
+        if ( freq[i] > 0 )
+            bits += double( freq[i] ) * cost( i );
+    }
+    for ( size_t i = 0; i < n; i++ )
+        if ( freq[i] > 0 )
+            entropy -= freq[i] * log2( freq[i] / total );
+    if ( total == 0 )
+        return;
+    r.avg_code_length = bits / total;
+    r.entropy = entropy / total;
+    if ( r.avg_code_length > 0 )
+        r.redundance_coeff = ( r.avg_code_length - r.entropy )
+                           / r.avg_code_length;
+}
+
+// Symbol weights of the synthetic distributions over n symbols.
+static bool synthetic_weights( const string& name, size_t n,
+                               vector<double>& weight )
+{
+    weight.assign( n, 0 );
+    for ( size_t i = 0; i < n; i++ ) {
+        if ( name == "uniform" )
+            weight[i] = 1;
+        else if ( name == "zipf" )
+            weight[i] = 1.0 / ( i + 1 );
+        else if ( name == "geometric" )
+            weight[i] = pow( 0.75, double( i ) );
+        else if ( name == "single" )
+            weight[i] = i == 0;
+        else
+            return false;
+    }
+    return true;
+}
+
+// Bytes drawn from a synthetic distribution through a 16-bit inverse
+// CDF table; the generator is seeded, so runs are comparable.
+static void synthetic_data( const string& name, size_t size,
+                            vector<uint8_t>& data )
+{
+    vector<double> weight;
+    synthetic_weights( name, ALPHABET, weight );
+    double total = 0;
+    for ( size_t i = 0; i < ALPHABET; i++ )
+        total += weight[i];
+    vector<uint8_t> table( 1 << 16 );
+    double cumulative = 0;
+    size_t symbol = 0;
+    for ( size_t i = 0; i < table.size(); i++ ) {
+        double point = ( i + 0.5 ) / table.size() * total;
+        while ( symbol + 1 < ALPHABET && cumulative + weight[symbol] < point )
+            cumulative += weight[ symbol++ ];
+        table[i] = uint8_t( symbol );
+    }
+    mt19937_64 random( 20131224 );
+    data.resize( size );
+    for ( size_t i = 0; i < size; i += 4 ) {
+        uint64_t r = random();
+        for ( size_t j = 0; j < 4 && i + j < size; j++ )
+            data[ i + j ] = table[ ( r >> ( 16 * j ) ) & 0xffff ];
+    }
+}
+
+// Best of opt.repeat runs, in seconds.
+template <class Run>
+static double best_time( unsigned repeat, Run run )
+{
+    double best = 1e300;
+    for ( unsigned i = 0; i < max( repeat, 1u ); i++ ) {
+        auto start = chrono::steady_clock::now();
+        run();
+        best = min( best, seconds_since( start ) );
+    }
+    return max( best, 1e-9 );
+}
+
+static bool bench_codebook( const string& source, size_t symbols,
+                            unsigned repeat, vector<BenchResult>& results )
+{
+    vector<double> weight;
+    if ( !synthetic_weights( source, symbols, weight ) )
+        return false;
+    // Counts as if 2^32 symbols were drawn, at least 1 per used symbol.
+    double total = 0;
+    for ( size_t i = 0; i < symbols; i++ )
+        total += weight[i];
+    vector<uint64_t> freq( symbols );
+    for ( size_t i = 0; i < symbols; i++ )
+        freq[i] = weight[i] > 0
+            ? max<uint64_t>( 1, uint64_t( weight[i] / total * 4294967296.0 ) )
+            : 0;
+
+    vector<uint8_t> lengths( symbols );
+    BenchResult r;
+    r.test = "codebook";
+    r.source = source;
+    r.symbols = symbols;
+    r.build_ms = 1000 * best_time( repeat, [&]() {
+        build_code_lengths( freq.data(), symbols, lengths.data() );
+    } );
+    code_statistics( freq.data(), symbols,
+                     [&]( size_t i ) { return double( lengths[i] ); }, r );
+    results.push_back( r );
+    return true;
+}
+
+static bool bench_codec( const string& source, const vector<uint8_t>& data,
+                         const Options& opt, vector<BenchResult>& results )
+{
+    BenchResult r;
+    r.test = "codec";
+    r.source = source;
+    r.bytes = data.size();
+
+    vector<uint64_t> freq( ALPHABET );
+    uint8_t lengths[ ALPHABET ];
+    HuffmanCodebook book;
+    bool built = true;
+    r.build_ms = 1000 * best_time( opt.repeat, [&]() {
+        fill( freq.begin(), freq.end(), 0 );
+        histogram( data.data(), data.size(), freq.data() );
+        unsigned longest = build_code_lengths( freq.data(), ALPHABET,
+                                               lengths, opt.max_length );
+        built &= ( longest > 0 || data.empty() )
+                 && book.deserialize( lengths );
+    } );
+    if ( !built ) {
+        cout << "Maximum code length " << opt.max_length
+             << " is too short for " << source << ".";
+        return false;
+    }
+    for ( size_t i = 0; i < ALPHABET; i++ )
+        r.symbols += freq[i] > 0;
+    code_statistics( freq.data(), ALPHABET,
+                     [&]( size_t i ) { return double( lengths[i] ); }, r );
+
+    vector<uint8_t> packed( payload_bound( data.size(), book.max_length() )
+                            + PAYLOAD_PADDING, 0 );
+    size_t size = 0;
+    double encode_time = best_time( opt.repeat, [&]() {
+        size = book.encode( data.data(), data.size(), packed.data() );
+    } );
+    vector<uint8_t> decoded( data.size() );
+    bool ok = true;
+    double decode_time = best_time( opt.repeat, [&]() {
+        ok &= book.decode( packed.data(), size, decoded.data(),
+                           data.size() );
+    } );
+    if ( !ok || decoded != data ) {
+        cout << "Round trip of " << source << " failed.";
+        return false;
+    }
+
+    r.encode_mbps = data.size() / 1e6 / encode_time;
+    r.decode_mbps = data.size() / 1e6 / decode_time;
+    r.ratio = data.empty() ? 0 : double( data.size() ) / size;
+    results.push_back( r );
+    return true;
+}
+
+// The same measurements for the tANS backend; avg_code_length is the
+// average symbol cost of its normalized counts.
+static bool bench_tans_codec( const string& source,
+                              const vector<uint8_t>& data,
+                              const Options& opt, vector<BenchResult>& results )
+{
+    BenchResult r;
+    r.test = "codec_tans";
+    r.source = source;
+    r.bytes = data.size();
+
+    vector<uint64_t> freq( ALPHABET );
+    tans::TansCodebook book;
+    r.build_ms = 1000 * best_time( opt.repeat, [&]() {
+        fill( freq.begin(), freq.end(), 0 );
+        histogram( data.data(), data.size(), freq.data() );
+        book.build( freq.data() );
+    } );
+    for ( size_t i = 0; i < ALPHABET; i++ )
+        r.symbols += freq[i] > 0;
+    code_statistics( freq.data(), ALPHABET,
+                     [&]( size_t i ) { return book.cost( uint8_t( i ) ); },
+                     r );
+
+    vector<uint8_t> packed( tans::payload_bound( data.size() ) );
+    size_t size = 0;
+    double encode_time = best_time( opt.repeat, [&]() {
+        size = book.encode( data.data(), data.size(), packed.data() );
+    } );
+    vector<uint8_t> decoded( data.size() );
+    bool ok = true;
+    double decode_time = best_time( opt.repeat, [&]() {
+        ok &= book.decode( packed.data(), size, decoded.data(),
+                           data.size() );
+    } );
+    if ( !ok || decoded != data ) {
+        cout << "Round trip of " << source << " failed.";
+        return false;
+    }
+
+    r.encode_mbps = data.size() / 1e6 / encode_time;
+    r.decode_mbps = data.size() / 1e6 / decode_time;
+    r.ratio = data.empty() ? 0 : double( data.size() ) / size;
+    results.push_back( r );
+    return true;
+}
+
+// Codebooks of every block of the data built as one batch with shared
+// scratch, as a per-block coder would. symbols is the average number of
+// symbols used by a block.
+static void bench_batch( const string& source, const vector<uint8_t>& data,
+                         size_t block_size, const Options& opt,
+                         vector<BenchResult>& results )
+{
+    size_t blocks = ( data.size() + block_size - 1 ) / block_size;
+    if ( blocks == 0 )
+        return;
+    vector<uint64_t> freqs( blocks * ALPHABET, 0 );
+    BenchResult r;
+    r.test = "batch";
+    r.source = source;
+    r.bytes = data.size();
+    r.block_size = block_size;
+    for ( size_t b = 0; b < blocks; b++ ) {
+        size_t first = b * block_size;
+        histogram( data.data() + first, min( block_size, data.size() - first ),
+                   &freqs[ b * ALPHABET ] );
+        for ( size_t i = 0; i < ALPHABET; i++ )
+            r.symbols += freqs[ b * ALPHABET + i ] > 0;
+    }
+    r.symbols /= blocks;
+
+    vector<HuffmanCodebook> books( blocks );
+    LengthScratch scratch;
+    double elapsed = best_time( opt.repeat, [&]() {
+        build_codebooks( freqs.data(), blocks, books.data(), scratch,
+                         opt.max_length );
+    } );
+    r.build_ms = 1000 * elapsed;
+    r.builds_per_sec = blocks / elapsed;
+    results.push_back( r );
+}
+
+// Batch builds for block sizes from 4K to 1M, or just --block-size.
+static void bench_batches( const string& source, const vector<uint8_t>& data,
+                           const Options& opt, vector<BenchResult>& results )
+{
+    if ( opt.block_size > 0 ) {
+        bench_batch( source, data, opt.block_size, opt, results );
+        return;
+    }
+    for ( size_t size = 4096; size <= ( size_t( 1 ) << 20 ); size <<= 2 )
+        bench_batch( source, data, size, opt, results );
+}
+
+// s as a JSON string literal, quotes included.
+static string json_string( const string& s )
+{
+    static const char hex[] = "0123456789abcdef";
+    string quoted = "\"";
+    for ( size_t i = 0; i < s.size(); i++ ) {
+        unsigned char c = s[i];
+        if ( c == '"' || c == '\\' ) {
+            quoted += '\\';
+            quoted += char( c );
+        }
+        else if ( c < 0x20 ) {
+            quoted += "\\u00";
+            quoted += hex[ c >> 4 ];
+            quoted += hex[ c & 15 ];
+        }
+        else
+            quoted += char( c );
+    }
+    return quoted + '"';
+}
+
+static void write_bench_report( ostream& out, const string& format,
+                                const vector<BenchResult>& results )
+{
+    if ( format == "json" ) {
+        out << "[\n";
+        for ( size_t i = 0; i < results.size(); i++ ) {
+            const BenchResult& r = results[i];
+            out << "  {\"test\": \"" << r.test << "\", \"source\": "
+                << json_string( r.source ) << ", \"symbols\": " << r.symbols
+                << ", \"bytes\": " << r.bytes
+                << ", \"build_ms\": " << r.build_ms
+                << ", \"encode_mbps\": " << r.encode_mbps
+                << ", \"decode_mbps\": " << r.decode_mbps
+                << ", \"ratio\": " << r.ratio
+                << ", \"avg_code_length\": " << r.avg_code_length
+                << ", \"entropy\": " << r.entropy
+                << ", \"redundance_coeff\": " << r.redundance_coeff
+                << ", \"block_size\": " << r.block_size
+                << ", \"builds_per_sec\": " << r.builds_per_sec << "}"
+                << ( i + 1 < results.size() ? "," : "" ) << "\n";
+        }
+        out << "]\n";
+        return;
+    }
+    out << "test,source,symbols,bytes,build_ms,encode_mbps,decode_mbps,"
+        << "ratio,avg_code_length,entropy,redundance_coeff,block_size,"
+        << "builds_per_sec\n";
+    for ( size_t i = 0; i < results.size(); i++ ) {
+        const BenchResult& r = results[i];
+        out << r.test << ',' << r.source << ',' << r.symbols << ','
+            << r.bytes << ',' << r.build_ms << ',' << r.encode_mbps << ','
+            << r.decode_mbps << ',' << r.ratio << ',' << r.avg_code_length
+            << ',' << r.entropy << ',' << r.redundance_coeff << ','
+            << r.block_size << ',' << r.builds_per_sec << "\n";
+    }
+}
+
+// Codebook build time against alphabet size, then encode and decode
+// speed and ratio of both backends and batch codebook builds on the
+// synthetic distributions and the files of --in, a comma separated list.
+static int bench( const Options& opt )
+{
+    static const char* sources[] = { "uniform", "zipf", "geometric", "single" };
+    vector<BenchResult> results;
+
+    for ( size_t s = 0; s < 4; s++ )
+        for ( size_t symbols = 256; symbols <= ( size_t( 1 ) << 22 );
+              symbols <<= 2 )
+            bench_codebook( sources[s], symbols, opt.repeat, results );
+
+    vector<uint8_t> data;
+    for ( size_t s = 0; s < 4; s++ ) {
+        synthetic_data( sources[s], opt.bench_size, data );
+        if ( !bench_codec( sources[s], data, opt, results )
+             || !bench_tans_codec( sources[s], data, opt, results ) )
+            return 0;
+        bench_batches( sources[s], data, opt, results );
+    }
+    for ( size_t begin = 0; begin < opt.in.size(); ) {
+        size_t end = opt.in.find( ',', begin );
+        if ( end == string::npos )
+            end = opt.in.size();
+        string name = opt.in.substr( begin, end - begin );
+        begin = end + 1;
+        if ( !read_file( name, data ) ) {
+            cout << "File " << name << " does not exist.";
+            return 0;
+        }
+        if ( !bench_codec( name, data, opt, results )
+             || !bench_tans_codec( name, data, opt, results ) )
+            return 0;
+        bench_batches( name, data, opt, results );
+    }
+
+    if ( opt.out == "-" ) {
+        write_bench_report( cout, opt.format, results );
+        return 0;
+    }
+    ofstream file( opt.out );
+    if ( !file ) {
+        cout << "File " << opt.out << " cannot be written.";
+        return 0;
+    }
+    write_bench_report( file, opt.format, results );
+    return 0;
+}
+
+// Sizes may carry a K, M or G suffix.
+static bool parse_size( const string& text, size_t& size )
+{
+    char* end;
+    unsigned long long value = strtoull( text.c_str(), &end, 10 );
+    if ( end == text.c_str() )
+        return false;
+    string suffix = end;
+    if ( suffix == "K" || suffix == "k" )
+        value <<= 10;
+    else if ( suffix == "M" || suffix == "m" )
+        value <<= 20;
+    else if ( suffix == "G" || suffix == "g" )
+        value <<= 30;
+    else if ( !suffix.empty() )
+        return false;
+    size = size_t( value );
+    return true;
+}
+
+int main( int argc, char* argv[] )
+{
+    Options opt;
+    if ( argc == 1 ) {
+        opt.in = "input.txt";
+        opt.out = "output.txt";
+    } else {
+        for ( int i = 1; i < argc; i++ ) {
+            string arg = argv[i];
+            size_t pos = arg.find( '=' );
+            if ( pos == string::npos ) {
+                usage( argv[0] );
+                return 0;
+            }
+            string param = arg.substr( 0, pos );
+            string value = arg.substr( pos + 1 );
+            bool valid = true;
+            if ( param == "--in" )
+                opt.in = value;
+            else if ( param == "--out" )
+                opt.out = value;
+            else if ( param == "--mode" )
+                opt.mode = value;
+            else if ( param == "--hist" )
+                opt.hist = value;
+            else if ( param == "--max-len" )
+                opt.max_length = unsigned( atoi( value.c_str() ) );
+            else if ( param == "--threads" )
+                opt.threads = unsigned( atoi( value.c_str() ) );
+            else if ( param == "--backend" )
+                opt.backend = value;
+            else if ( param == "--block-size" )
+                valid = parse_size( value, opt.block_size );
+            else if ( param == "--stream" )
+                valid = parse_size( value, opt.chunk_size );
+            else if ( param == "--offset" )
+                valid = parse_size( value, opt.offset );
+            else if ( param == "--length" )
+                valid = parse_size( value, opt.length );
+            else if ( param == "--format" )
+                opt.format = value;
+            else if ( param == "--bench-size" )
+                valid = parse_size( value, opt.bench_size );
+            else if ( param == "--repeat" )
+                opt.repeat = unsigned( atoi( value.c_str() ) );
+            else
+                valid = false;
+            if ( !valid ) {
+                usage( argv[0] );
+                return 0;
+            }
+        }
+    }
+    if ( opt.mode == "encode" || opt.mode == "bench" ) {
+        if ( opt.max_length == 0 )
+            opt.max_length = MAX_CODE_LENGTH;
+        if ( opt.max_length > MAX_CODE_LENGTH ) {
+            cout << "Maximum code length must not exceed "
+                 << MAX_CODE_LENGTH << ".";
+            return 0;
+        }
+    }
+    if ( opt.mode == "bench" ) {
+        if ( opt.out.empty() )
+            opt.out = "-";
+        return bench( opt );
+    }
+    if ( opt.in.empty() || opt.out.empty()
+         || ( opt.backend != "huffman" && opt.backend != "tans"
+              && opt.backend != "auto" ) ) {
+        usage( argv[0] );
+        return 0;
+    }
+    if ( opt.in == opt.out && opt.in != "-" ) {
+        cout << "Input and output files must be different.";
+        return 0;
+    }
+    if ( opt.threads == 0 )
+        opt.threads = max( thread::hardware_concurrency(), 1u );
+    if ( ( opt.threads > 1 || opt.backend != "huffman" )
+         && opt.block_size == 0 )
+        opt.block_size = size_t( 4 ) << 20;
+
+    if ( opt.mode == "codes" )
+        return print_codes( opt.in, opt.out );
+    else if ( opt.mode == "encode" ) {
+        if ( opt.chunk_size > 0 && opt.backend != "huffman" ) {
+            cout << "Streams are coded with the huffman backend only.";
+            return 0;
+        }
+        return encode_file( opt );
+    }
+    else if ( opt.mode == "decode" )
+        return decode_file( opt );
+    else if ( opt.mode == "lengths" )
+        return build_lengths_file( opt.in, opt.out, opt.hist, opt.max_length );
+
+    usage( argv[0] );
+    return 0;
 }
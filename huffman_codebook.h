@@ -0,0 +1,780 @@
+// Canonical Huffman coding of bytes: code length construction for
+// alphabets of any size, the HuffmanCodebook with its encoder and
+// decoder tables, and the payload coder built on them.
+
+#ifndef HUFFMAN_CODEBOOK_H
+#define HUFFMAN_CODEBOOK_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace huffman
+{
+
+const size_t ALPHABET = 256;
+// Longest code the encoder emits. The decoder keeps at least 56 bits
+// in its bit buffer, so one refill is always enough for any code.
+const unsigned MAX_CODE_LENGTH = 32;
+// Codes not longer than this are decoded with a single table lookup.
+const unsigned TABLE_BITS = 11;
+// The decoder reads whole 64-bit words, so the payload is padded.
+const size_t PAYLOAD_PADDING = 16;
+// Every payload is split into this many interleaved bit streams.
+const size_t PAYLOAD_STREAMS = 4;
+const size_t JUMP_TABLE_SIZE = ( PAYLOAD_STREAMS - 1 ) * 8;
+
+inline void put_le64( uint8_t* p, uint64_t v )
+{
+    for ( size_t i = 0; i < 8; i++ )
+        p[i] = uint8_t( v >> ( 8 * i ) );
+}
+
+inline uint64_t get_le64( const uint8_t* p )
+{
+    uint64_t v = 0;
+    for ( size_t i = 0; i < 8; i++ )
+        v |= uint64_t( p[i] ) << ( 8 * i );
+    return v;
+}
+
+inline uint64_t get_be64( const uint8_t* p )
+{
+    uint64_t v;
+    std::memcpy( &v, p, 8 );
+    return __builtin_bswap64( v );
+}
+
+// Adds the byte counts of the data to freq. Consecutive bytes go to
+// four different sub-tables: a run of one value would otherwise make
+// every increment wait for the store of the previous one.
+inline void histogram( const uint8_t* data, size_t n, uint64_t* freq )
+{
+    uint32_t counts[4][ ALPHABET ];
+    while ( n > 0 ) {
+        // 32-bit counters can't overflow within a batch.
+        size_t batch = std::min( n, size_t( 1 ) << 30 );
+        std::memset( counts, 0, sizeof( counts ) );
+        size_t i = 0;
+        for ( ; i + 8 <= batch; i += 8 ) {
+            uint64_t word;
+            std::memcpy( &word, data + i, 8 );
+            counts[0][ word & 0xff ]++;
+            counts[1][ ( word >> 8 ) & 0xff ]++;
+            counts[2][ ( word >> 16 ) & 0xff ]++;
+            counts[3][ ( word >> 24 ) & 0xff ]++;
+            counts[0][ ( word >> 32 ) & 0xff ]++;
+            counts[1][ ( word >> 40 ) & 0xff ]++;
+            counts[2][ ( word >> 48 ) & 0xff ]++;
+            counts[3][ word >> 56 ]++;
+        }
+        for ( ; i < batch; i++ )
+            counts[0][ data[i] ]++;
+        for ( size_t c = 0; c < ALPHABET; c++ )
+            freq[c] += uint64_t( counts[0][c] ) + counts[1][c]
+                     + counts[2][c] + counts[3][c];
+        data += batch;
+        n -= batch;
+    }
+}
+
+// Working memory of the code length construction. Buffers are resized
+// but never shrunk, so one scratch reused for histograms of the same
+// or a smaller alphabet builds without touching the heap.
+struct LengthScratch
+{
+    // Sizes every buffer for alphabets of up to n symbols and codes of
+    // up to max_length bits, whatever the histograms turn out to be.
+    void reserve( size_t n, unsigned max_length )
+    {
+        keys.reserve( n );
+        buffer.reserve( n );
+        weight.reserve( n );
+        original.reserve( n );
+        list.reserve( 2 * n );
+        merged.reserve( 2 * n );
+        order.reserve( n );
+        counts.reserve( size_t( 8 ) << 11 );
+        pairs.reserve( n );
+        if ( is_leaf.size() < max_length )
+            is_leaf.resize( max_length );
+        for ( size_t i = 0; i < is_leaf.size(); i++ )
+            is_leaf[i].reserve( 2 * n );
+        limited.reserve( n );
+    }
+
+    std::vector<uint64_t> keys, buffer, weight, original, list, merged;
+    std::vector<uint32_t> order;
+    std::vector<size_t> counts;
+    std::vector< std::pair<uint64_t, uint32_t> > pairs;
+    std::vector< std::vector<bool> > is_leaf;
+    std::vector<uint8_t> limited;
+};
+
+// Stable LSD radix sort on the key bits from first_bit up, 11 bits per
+// pass, or 8 for short arrays, which would not fill the buckets. Digits
+// that are equal in every key are skipped, so for small frequencies
+// only one or two passes remain.
+inline void radix_sort( std::vector<uint64_t>& keys, unsigned first_bit,
+                        LengthScratch& scratch )
+{
+    size_t n = keys.size();
+    const unsigned DIGIT_BITS = n < 4096 ? 8 : 11;
+    const size_t BUCKETS = size_t( 1 ) << DIGIT_BITS;
+    if ( n == 0 )
+        return;
+    // Digits above the highest key bit are 0 in every key.
+    uint64_t high = 0;
+    for ( size_t i = 0; i < n; i++ )
+        high |= keys[i];
+    unsigned passes = 0;
+    for ( high >>= first_bit; high > 0; high >>= DIGIT_BITS )
+        passes++;
+
+    std::vector<size_t>& counts = scratch.counts;
+    counts.assign( passes * BUCKETS, 0 );
+    for ( size_t i = 0; i < n; i++ ) {
+        uint64_t key = keys[i] >> first_bit;
+        for ( unsigned d = 0; d < passes; d++, key >>= DIGIT_BITS )
+            counts[ d * BUCKETS + ( key & ( BUCKETS - 1 ) ) ]++;
+    }
+
+    std::vector<uint64_t>& buffer = scratch.buffer;
+    buffer.resize( n );
+    for ( unsigned d = 0; d < passes; d++ ) {
+        unsigned shift = first_bit + d * DIGIT_BITS;
+        size_t* count = &counts[ d * BUCKETS ];
+        if ( count[ ( keys[0] >> shift ) & ( BUCKETS - 1 ) ] == n )
+            continue;
+        size_t sum = 0;
+        for ( size_t b = 0; b < BUCKETS; b++ ) {
+            size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for ( size_t i = 0; i < n; i++ )
+            buffer[ count[ ( keys[i] >> shift ) & ( BUCKETS - 1 ) ]++ ] = keys[i];
+        keys.swap( buffer );
+    }
+}
+
+// Collects the used symbols sorted by frequency, ascending.
+// weight[i] is the frequency of symbol order[i].
+inline void sort_by_frequency( const uint64_t* freq, size_t n,
+                               std::vector<uint64_t>& weight,
+                               std::vector<uint32_t>& order,
+                               LengthScratch& scratch )
+{
+    uint64_t max_freq = 0;
+    size_t used = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        max_freq = std::max( max_freq, freq[i] );
+        used += freq[i] > 0;
+    }
+    weight.resize( used );
+    order.resize( used );
+
+    unsigned index_bits = 1;
+    while ( index_bits < 32 && ( uint64_t( 1 ) << index_bits ) < n )
+        index_bits++;
+
+    if ( index_bits < 64 && ( max_freq >> ( 64 - index_bits ) ) == 0 ) {
+        // Frequency and symbol fit into one 64-bit key. The keys are
+        // generated in symbol order, so a stable sort on the frequency
+        // bits alone orders them completely.
+        std::vector<uint64_t>& keys = scratch.keys;
+        keys.resize( used );
+        for ( size_t i = 0, k = 0; i < n; i++ )
+            if ( freq[i] > 0 )
+                keys[ k++ ] = ( freq[i] << index_bits ) | i;
+        radix_sort( keys, index_bits, scratch );
+        uint64_t mask = ( uint64_t( 1 ) << index_bits ) - 1;
+        for ( size_t i = 0; i < used; i++ ) {
+            weight[i] = keys[i] >> index_bits;
+            order[i] = uint32_t( keys[i] & mask );
+        }
+    } else {
+        std::vector< std::pair<uint64_t, uint32_t> >& pairs = scratch.pairs;
+        pairs.clear();
+        for ( size_t i = 0; i < n; i++ )
+            if ( freq[i] > 0 )
+                pairs.push_back( std::make_pair( freq[i], uint32_t( i ) ) );
+        std::sort( pairs.begin(), pairs.end() );
+        for ( size_t i = 0; i < used; i++ ) {
+            weight[i] = pairs[i].first;
+            order[i] = pairs[i].second;
+        }
+    }
+}
+
+// Moffat & Katajainen, "In-place calculation of minimum-redundancy
+// codes". Takes ascending weights and replaces them with the code
+// lengths in O(n): the sorted leaves and the internal nodes, which are
+// created in ascending order, act as the two queues of the classic
+// two-queue construction, and parent links, depths and finally leaf
+// depths all reuse the same array.
+constexpr void minimum_redundancy_lengths( uint64_t* a, size_t n )
+{
+    if ( n == 0 )
+        return;
+    if ( n == 1 ) {
+        a[0] = 1;
+        return;
+    }
+
+    // Left to right: combine nodes, leaving parent pointers behind.
+    size_t root = 0, leaf = 2;
+    a[0] += a[1];
+    for ( size_t next = 1; next < n - 1; next++ ) {
+        if ( leaf >= n || a[root] < a[leaf] ) {
+            a[next] = a[root];
+            a[root++] = next;
+        } else
+            a[next] = a[leaf++];
+
+        if ( leaf >= n || ( root < next && a[root] < a[leaf] ) ) {
+            a[next] += a[root];
+            a[root++] = next;
+        } else
+            a[next] += a[leaf++];
+    }
+
+    // Right to left: turn parent pointers into internal node depths.
+    a[ n - 2 ] = 0;
+    for ( size_t next = n - 2; next-- > 0; )
+        a[next] = a[ a[next] ] + 1;
+
+    // Right to left: count internal nodes per level to get leaf depths.
+    size_t available = 1, used = 0, depth = 0;
+    ptrdiff_t internal = ptrdiff_t( n ) - 2;
+    ptrdiff_t next = ptrdiff_t( n ) - 1;
+    while ( available > 0 ) {
+        while ( internal >= 0 && a[internal] == depth ) {
+            used++;
+            internal--;
+        }
+        while ( available > used ) {
+            a[ next-- ] = depth;
+            available--;
+        }
+        available = 2 * used;
+        depth++;
+        used = 0;
+    }
+}
+
+// Package-merge (Larmore & Hirschberg) on ascending weights: optimal
+// code lengths with none longer than max_length, written in the order
+// of the weights. Every level's list is remembered only as leaf/package
+// flags, which is enough to count afterwards in how many levels each
+// leaf was selected. O(n * max_length) time, n * max_length bits.
+inline void package_merge_lengths( const uint64_t* weight, size_t n,
+                                   unsigned max_length, uint8_t* lengths,
+                                   LengthScratch& scratch )
+{
+    // Level 0 is the deepest one and holds nothing but leaves.
+    std::vector< std::vector<bool> >& is_leaf = scratch.is_leaf;
+    if ( is_leaf.size() < max_length )
+        is_leaf.resize( max_length );
+    std::vector<uint64_t>& list = scratch.list;
+    std::vector<uint64_t>& merged = scratch.merged;
+    list.assign( weight, weight + n );
+    is_leaf[0].assign( n, true );
+    for ( unsigned level = 1; level < max_length; level++ ) {
+        size_t packages = list.size() / 2;
+        merged.resize( n + packages );
+        std::vector<bool>& flags = is_leaf[level];
+        flags.resize( n + packages );
+        size_t i = 0, j = 0;
+        for ( size_t k = 0; k < merged.size(); k++ ) {
+            uint64_t package = j < packages
+                ? list[ 2 * j ] + list[ 2 * j + 1 ] : 0;
+            bool leaf = j == packages || ( i < n && weight[i] <= package );
+            merged[k] = leaf ? weight[ i++ ] : package;
+            flags[k] = leaf;
+            j += !leaf;
+        }
+        list.swap( merged );
+    }
+
+    // The 2n - 2 cheapest items of the top level form the code. Walking
+    // down, the selected packages of a level expand into twice as many
+    // items of the level below; selected leaves gain one bit of length.
+    std::memset( lengths, 0, n );
+    size_t take = 2 * n - 2;
+    for ( unsigned level = max_length; level-- > 0; ) {
+        size_t leaves = 0;
+        for ( size_t k = 0; k < take; k++ )
+            leaves += is_leaf[level][k];
+        for ( size_t k = 0; k < leaves; k++ )
+            lengths[k]++;
+        take = 2 * ( take - leaves );
+    }
+}
+
+// Code length of every symbol of the histogram, none longer than
+// max_length (0 means no limit). Unused symbols get length 0, a lone
+// symbol gets 1. If given, unlimited_bits receives the size of the data
+// under the unconstrained code. Returns the longest length, or 0 if the
+// alphabet has too many symbols for max_length.
+inline unsigned build_code_lengths( const uint64_t* freq, size_t n,
+                                    uint8_t* lengths, LengthScratch& scratch,
+                                    unsigned max_length = 0,
+                                    double* unlimited_bits = 0 )
+{
+    std::vector<uint64_t>& weight = scratch.weight;
+    std::vector<uint32_t>& order = scratch.order;
+    sort_by_frequency( freq, n, weight, order, scratch );
+    std::vector<uint64_t>& original = scratch.original;
+    if ( max_length > 0 || unlimited_bits )
+        original = weight;
+    minimum_redundancy_lengths( weight.data(), weight.size() );
+
+    // Weights were ascending, so the first length is the longest one.
+    unsigned longest = weight.empty() ? 0 : unsigned( weight[0] );
+    if ( unlimited_bits ) {
+        *unlimited_bits = 0;
+        for ( size_t i = 0; i < weight.size(); i++ )
+            *unlimited_bits += double( original[i] ) * weight[i];
+    }
+
+    std::memset( lengths, 0, n );
+    if ( max_length > 0 && longest > max_length ) {
+        if ( max_length < 32 && ( size_t( 1 ) << max_length ) < weight.size() )
+            return 0;
+        std::vector<uint8_t>& limited = scratch.limited;
+        limited.resize( weight.size() );
+        package_merge_lengths( original.data(), original.size(), max_length,
+                               limited.data(), scratch );
+        for ( size_t i = 0; i < limited.size(); i++ )
+            lengths[ order[i] ] = limited[i];
+        return limited[0];
+    }
+    for ( size_t i = 0; i < weight.size(); i++ )
+        lengths[ order[i] ] = uint8_t( weight[i] );
+    return longest;
+}
+
+// The same with scratch of its own, for one-off builds.
+inline unsigned build_code_lengths( const uint64_t* freq, size_t n,
+                                    uint8_t* lengths,
+                                    unsigned max_length = 0,
+                                    double* unlimited_bits = 0 )
+{
+    LengthScratch scratch;
+    return build_code_lengths( freq, n, lengths, scratch, max_length,
+                               unlimited_bits );
+}
+
+// Codes of every symbol, the only thing the encoder needs.
+struct EncodeTable
+{
+    uint32_t code[ ALPHABET ] = {};
+    uint8_t length[ ALPHABET ] = {};
+    unsigned max_length = 0;
+};
+
+// Entry of the fast table: (symbol << 8) | code length. Length 0 marks
+// codes longer than the table, those are searched per length with the
+// canonical first code, count and position of the first symbol in
+// 'sorted'.
+struct DecodeTable
+{
+    unsigned max_length = 0;
+    unsigned bits = 1;
+    uint16_t fast[ size_t( 1 ) << TABLE_BITS ] = {};
+    uint32_t first_code[ MAX_CODE_LENGTH + 1 ] = {};
+    uint32_t count[ MAX_CODE_LENGTH + 1 ] = {};
+    uint32_t offset[ MAX_CODE_LENGTH + 1 ] = {};
+    uint8_t sorted[ ALPHABET ] = {};
+};
+
+// Canonical code of a byte alphabet: shorter codes first, ties broken
+// by the symbol, so the code lengths are all it takes to rebuild it.
+// It has no heap members and can be built at compile time, see
+// from_static_histogram().
+class HuffmanCodebook
+{
+public:
+    // Builds the code of a histogram of ALPHABET counts. Returns false
+    // if max_length is too short for the number of used symbols.
+    bool build( const uint64_t* freq, unsigned max_length = MAX_CODE_LENGTH,
+                double* unlimited_bits = 0 )
+    {
+        LengthScratch scratch;
+        return build( freq, scratch, max_length, unlimited_bits );
+    }
+
+    // The same with caller owned scratch, see build_codebooks().
+    bool build( const uint64_t* freq, LengthScratch& scratch,
+                unsigned max_length = MAX_CODE_LENGTH,
+                double* unlimited_bits = 0 )
+    {
+        uint8_t lengths[ ALPHABET ];
+        unsigned longest = build_code_lengths( freq, ALPHABET, lengths,
+                                               scratch, max_length,
+                                               unlimited_bits );
+        if ( longest == 0 )
+            for ( size_t i = 0; i < ALPHABET; i++ )
+                if ( freq[i] > 0 )
+                    return false;
+        return assign( lengths );
+    }
+
+    // The code of a fixed distribution, evaluated by the compiler when
+    // used in a constant expression:
+    //     constexpr HuffmanCodebook book =
+    //         HuffmanCodebook::from_static_histogram( FREQ );
+    // Codes are kept within max_length by flattening the counts, which
+    // for tables built once is close enough to package-merge. The
+    // default keeps every code in the fast decoder table. Throws
+    // std::length_error if more than 2^max_length symbols are used,
+    // which in a constant expression fails the compilation instead.
+    static constexpr HuffmanCodebook from_static_histogram(
+        const uint64_t ( &freq )[ ALPHABET ], unsigned max_length = TABLE_BITS )
+    {
+        uint64_t scaled[ ALPHABET ] = {};
+        for ( size_t i = 0; i < ALPHABET; i++ )
+            scaled[i] = freq[i];
+
+        uint8_t lengths[ ALPHABET ] = {};
+        unsigned longest = 0;
+        for ( bool done = false; !done; ) {
+            // Insertion sort of the used symbols by (count, symbol).
+            uint64_t weight[ ALPHABET ] = {};
+            size_t order[ ALPHABET ] = {};
+            size_t used = 0;
+            for ( size_t i = 0; i < ALPHABET; i++ ) {
+                if ( scaled[i] == 0 )
+                    continue;
+                size_t j = used++;
+                for ( ; j > 0 && weight[ j - 1 ] > scaled[i]; j-- ) {
+                    weight[j] = weight[ j - 1 ];
+                    order[j] = order[ j - 1 ];
+                }
+                weight[j] = scaled[i];
+                order[j] = i;
+            }
+            minimum_redundancy_lengths( weight, used );
+
+            bool flat = true;
+            for ( size_t i = 0; i < ALPHABET; i++ )
+                flat = flat && scaled[i] <= 1;
+            done = used == 0 || weight[0] <= max_length || flat;
+            if ( done && used > 0 )
+                longest = unsigned( weight[0] );
+            if ( done )
+                for ( size_t i = 0; i < used; i++ )
+                    lengths[ order[i] ] = uint8_t( weight[i] );
+            else
+                for ( size_t i = 0; i < ALPHABET; i++ )
+                    if ( scaled[i] > 0 )
+                        scaled[i] = ( scaled[i] >> 1 ) | 1;
+        }
+
+        // Flat counts that still need longer codes leave no way to meet
+        // max_length.
+        HuffmanCodebook book;
+        if ( longest > max_length || !book.assign( lengths ) )
+            throw std::length_error( "max_length is too short for the histogram" );
+        return book;
+    }
+
+    // Canonical codes and decoder tables from ALPHABET code lengths.
+    // Returns false unless the lengths describe a prefix code.
+    constexpr bool assign( const uint8_t* lengths )
+    {
+        enc_ = EncodeTable();
+        dec_ = DecodeTable();
+        for ( size_t i = 0; i < ALPHABET; i++ ) {
+            if ( lengths[i] > MAX_CODE_LENGTH )
+                return false;
+            enc_.length[i] = lengths[i];
+            dec_.count[ lengths[i] ]++;
+            enc_.max_length = std::max<unsigned>( enc_.max_length,
+                                                  lengths[i] );
+        }
+        dec_.count[0] = 0;
+        dec_.max_length = enc_.max_length;
+
+        uint64_t code = 0;
+        uint32_t offset = 0;
+        uint32_t next[ MAX_CODE_LENGTH + 1 ] = {};
+        for ( unsigned len = 1; len <= MAX_CODE_LENGTH; len++ ) {
+            code = ( code + dec_.count[ len - 1 ] ) << 1;
+            dec_.first_code[len] = uint32_t( code );
+            dec_.offset[len] = next[len] = offset;
+            offset += dec_.count[len];
+            // Kraft inequality: the lengths must describe a prefix code.
+            if ( code + dec_.count[len] > ( uint64_t( 1 ) << len ) )
+                return false;
+        }
+
+        for ( size_t i = 0; i < ALPHABET; i++ ) {
+            unsigned len = enc_.length[i];
+            if ( len == 0 )
+                continue;
+            uint32_t rank = next[len]++;
+            dec_.sorted[ rank ] = uint8_t( i );
+            enc_.code[i] = dec_.first_code[len] + rank - dec_.offset[len];
+        }
+
+        dec_.bits = std::min( TABLE_BITS, std::max( enc_.max_length, 1u ) );
+        for ( size_t i = 0; i < ALPHABET; i++ ) {
+            unsigned len = enc_.length[i];
+            if ( len == 0 || len > dec_.bits )
+                continue;
+            size_t first = size_t( enc_.code[i] ) << ( dec_.bits - len );
+            size_t last = first + ( size_t( 1 ) << ( dec_.bits - len ) );
+            for ( size_t j = first; j < last; j++ )
+                dec_.fast[j] = uint16_t( ( i << 8 ) | len );
+        }
+        return true;
+    }
+
+    // The serialized codebook is its ALPHABET code lengths.
+    static const size_t SERIALIZED_SIZE = ALPHABET;
+
+    void serialize( uint8_t* out ) const
+    {
+        std::memcpy( out, enc_.length, ALPHABET );
+    }
+
+    bool deserialize( const uint8_t* in )
+    {
+        return assign( in );
+    }
+
+    constexpr const EncodeTable& encoder() const { return enc_; }
+    constexpr const DecodeTable& decoder() const { return dec_; }
+    constexpr unsigned max_length() const { return enc_.max_length; }
+    constexpr unsigned length( uint8_t symbol ) const
+    {
+        return enc_.length[ symbol ];
+    }
+
+    // See encode_payload() and decode_payload().
+    size_t encode( const uint8_t* data, size_t n, uint8_t* out ) const;
+    bool decode( const uint8_t* src, size_t src_size,
+                 uint8_t* dst, size_t n ) const;
+
+private:
+    EncodeTable enc_;
+    DecodeTable dec_;
+};
+
+// Builds the codebooks of count histograms of ALPHABET counts each,
+// stored one after another, e.g. those of the blocks of a file. All
+// builds share the scratch, which only the first batch has to size, so
+// the builds after it run without heap allocation. Returns false if any
+// histogram has too many symbols for max_length.
+inline bool build_codebooks( const uint64_t* freqs, size_t count,
+                             HuffmanCodebook* books, LengthScratch& scratch,
+                             unsigned max_length = MAX_CODE_LENGTH )
+{
+    scratch.reserve( ALPHABET, max_length );
+    bool ok = true;
+    for ( size_t i = 0; i < count; i++ )
+        ok &= books[i].build( freqs + i * ALPHABET, scratch, max_length );
+    return ok;
+}
+
+// Codes are packed MSB first. Returns the number of bytes written to
+// out, which must hold n * max_length / 8 + 8 bytes.
+inline size_t encode_bits( const uint8_t* data, size_t n,
+                           const EncodeTable& table, uint8_t* out )
+{
+    uint8_t* p = out;
+    uint64_t acc = 0;
+    unsigned bits = 0;
+    for ( size_t i = 0; i < n; i++ ) {
+        unsigned len = table.length[ data[i] ];
+        acc = ( acc << len ) | table.code[ data[i] ];
+        bits += len;
+        if ( bits >= 32 ) {
+            bits -= 32;
+            uint32_t word = uint32_t( acc >> bits );
+            p[0] = uint8_t( word >> 24 );
+            p[1] = uint8_t( word >> 16 );
+            p[2] = uint8_t( word >> 8 );
+            p[3] = uint8_t( word );
+            p += 4;
+        }
+    }
+    while ( bits >= 8 ) {
+        bits -= 8;
+        *p++ = uint8_t( acc >> bits );
+    }
+    if ( bits > 0 )
+        *p++ = uint8_t( acc << ( 8 - bits ) );
+    return p - out;
+}
+
+// Size of the n-th of the four segments a payload is split into.
+inline size_t segment_size( size_t n, size_t k )
+{
+    size_t segment = ( n + PAYLOAD_STREAMS - 1 ) / PAYLOAD_STREAMS;
+    return std::min( segment, n - std::min( n, k * segment ) );
+}
+
+// Upper bound of encode_payload's output.
+inline size_t payload_bound( size_t n, unsigned max_length )
+{
+    return n * max_length / 8 + PAYLOAD_STREAMS * 8 + JUMP_TABLE_SIZE;
+}
+
+// The data is cut into four segments, each coded into its own bit
+// stream, so the decoder can follow four independent dependency chains
+// at once. The payload starts with the sizes of the first three streams.
+inline size_t encode_payload( const uint8_t* data, size_t n,
+                              const EncodeTable& table, uint8_t* out )
+{
+    uint8_t* p = out + JUMP_TABLE_SIZE;
+    for ( size_t k = 0; k < PAYLOAD_STREAMS; k++ ) {
+        size_t size = encode_bits( data, segment_size( n, k ), table, p );
+        if ( k + 1 < PAYLOAD_STREAMS )
+            put_le64( out + 8 * k, size );
+        data += segment_size( n, k );
+        p += size;
+    }
+    return p - out;
+}
+
+// MSB first bit buffer that keeps at least 56 bits after a refill.
+struct BitReader
+{
+    void init( const uint8_t* src, size_t size )
+    {
+        p = src;
+        end = src + size;
+        buf = 0;
+        avail = 0;
+    }
+
+    // A valid stream never reads past its padding.
+    bool refill()
+    {
+        if ( p > end + 8 )
+            return false;
+        buf |= get_be64( p ) >> avail;
+        p += ( 63 - avail ) >> 3;
+        avail |= 56;
+        return true;
+    }
+
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t buf;
+    unsigned avail;
+};
+
+// Codes longer than the fast table, searched length by length.
+inline bool decode_slow( BitReader& in, const DecodeTable& table,
+                         uint8_t& symbol )
+{
+    for ( unsigned len = table.bits + 1; len <= table.max_length; len++ ) {
+        uint32_t index = uint32_t( in.buf >> ( 64 - len ) )
+                       - table.first_code[len];
+        if ( index < table.count[len] ) {
+            symbol = table.sorted[ table.offset[len] + index ];
+            in.buf <<= len;
+            in.avail -= len;
+            return true;
+        }
+    }
+    return false;
+}
+
+// One symbol; the caller makes sure the buffer holds a whole code.
+inline bool decode_symbol( BitReader& in, const DecodeTable& table,
+                           uint8_t& symbol )
+{
+    uint16_t entry = table.fast[ in.buf >> ( 64 - table.bits ) ];
+    unsigned len = entry & 0xff;
+    if ( len == 0 )
+        return decode_slow( in, table, symbol );
+    symbol = uint8_t( entry >> 8 );
+    in.buf <<= len;
+    in.avail -= len;
+    return true;
+}
+
+// Decodes n symbols of a single bit stream.
+inline bool decode_bits( BitReader& in, const DecodeTable& table,
+                         uint8_t* dst, size_t n )
+{
+    // Number of symbols guaranteed to fit into one refill.
+    size_t per_refill = 56 / std::max( table.max_length, 1u );
+    size_t i = 0;
+    while ( i < n ) {
+        if ( !in.refill() )
+            return false;
+        size_t stop = std::min( n, i + per_refill );
+        for ( ; i < stop; i++ )
+            if ( !decode_symbol( in, table, dst[i] ) )
+                return false;
+    }
+    return true;
+}
+
+// Decodes n symbols. src must be followed by PAYLOAD_PADDING readable
+// bytes. The four streams are decoded in one loop while all of them
+// have symbols left; table lookups of different streams don't depend on
+// each other and overlap in the pipeline. Returns false on a corrupted
+// payload.
+inline bool decode_payload( const uint8_t* src, size_t src_size,
+                            const DecodeTable& table, uint8_t* dst, size_t n )
+{
+    if ( src_size < JUMP_TABLE_SIZE )
+        return false;
+    BitReader in[ PAYLOAD_STREAMS ];
+    uint8_t* out[ PAYLOAD_STREAMS ];
+    size_t offset = JUMP_TABLE_SIZE;
+    for ( size_t k = 0; k < PAYLOAD_STREAMS; k++ ) {
+        size_t size = k + 1 < PAYLOAD_STREAMS
+            ? size_t( get_le64( src + 8 * k ) ) : src_size - offset;
+        if ( size > src_size - offset )
+            return false;
+        in[k].init( src + offset, size );
+        out[k] = dst;
+        offset += size;
+        dst += segment_size( n, k );
+    }
+
+    size_t per_refill = 56 / std::max( table.max_length, 1u );
+    size_t rounds = segment_size( n, PAYLOAD_STREAMS - 1 ) / per_refill;
+    bool ok = true;
+    for ( size_t r = 0; r < rounds && ok; r++ ) {
+        for ( size_t k = 0; k < PAYLOAD_STREAMS; k++ )
+            ok &= in[k].refill();
+        for ( size_t i = 0; i < per_refill && ok; i++ )
+            for ( size_t k = 0; k < PAYLOAD_STREAMS; k++ )
+                ok &= decode_symbol( in[k], table, *out[k]++ );
+    }
+    // The tails of the longer segments.
+    for ( size_t k = 0; k < PAYLOAD_STREAMS && ok; k++ )
+        ok = decode_bits( in[k], table, out[k],
+                          segment_size( n, k ) - rounds * per_refill );
+    return ok;
+}
+
+
+inline size_t HuffmanCodebook::encode( const uint8_t* data, size_t n,
+                                       uint8_t* out ) const
+{
+    return encode_payload( data, n, enc_, out );
+}
+
+inline bool HuffmanCodebook::decode( const uint8_t* src, size_t src_size,
+                                     uint8_t* dst, size_t n ) const
+{
+    return decode_payload( src, src_size, dec_, dst, n );
+}
+
+} // namespace huffman
+
+#endif // HUFFMAN_CODEBOOK_H
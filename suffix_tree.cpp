@@ -1,31 +1,48 @@
-#include <map>
-#include <set>
-#include <list>
-#include <stack>
+#include <vector>
+#include <string>
+#include <climits>
+#include <cstdint>
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdio>
+#include <random>
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "suffix_array.h"
 
 using namespace std;
 
 // Used to define direction of an Edge and suffix link.
+// Nodes refer to each other by their index in the nodes arena.
 struct Node
 {
-    Node() : parent(0), depth(0), suffixLink(-1){}
+    Node(int parent, int depth, int start)
+        : parent(parent), depth(depth), start(start), suffixLink(-1),
+          words(0) {}
 
-    Node* parent;
-    int depth;
+    int parent;     // -1 for the root.
+    int depth;      // Length of the path label.
+    int start;      // The path label is s[start, start + depth).
     int suffixLink;
-    char firstEdgeChar;
-
-    // Represents different leafs of branch node.
-    set<int> leafKinds;
-
-    // Used to identify Nodes in an array.
-    static size_t count;
+    int words;      // Number of different words with a leaf below.
 };
 
-size_t Node::count = 1; // Root is already there.
-
 // Active/end points are referenced like this: (node, (l, r)).
 struct ReferencePair
 {
@@ -43,12 +60,175 @@ struct ReferencePair
     int left, right; // Indices of the active/end point.
 };
 
-// Input string.
-string s;
-// Enough for the task.
-const size_t MAXNODES = 250000;
-// When STree will be created MAXNODES ctors will be called.
-Node nodes[MAXNODES];
+// Input words, each followed by its terminator. Symbols below 256 are
+// bytes; word i is terminated by the sentinel TERMINATOR + i, which
+// occurs nowhere else, so any number of words can be joined.
+vector<int> s;
+const int TERMINATOR = 256;
+// The words as read, each followed by the separator, which no word
+// contains as words are read up to white space.
+string text;
+const char SEPARATOR = '\n';
+
+// Positions count the symbols appended since the tree was reset, and
+// the text ends before front. In window mode s is a ring holding the
+// symbols from tail on; otherwise tail is 0 and s holds them all.
+int front = 0, tail = 0;
+int textMask = -1;
+
+// A text of at most four different bytes, as DNA is, at 2 bits a
+// symbol. Terminators are marked in a bitvector of their own, with the
+// count of those before every 64 symbols, which numbers them.
+class PackedText
+{
+public:
+    PackedText() : length(0) {}
+
+    // Packs the words of text, which end at wordEnds, each with the
+    // separator. False, and nothing packed, if they have more than four
+    // different bytes.
+    bool pack(const string& text, const vector<uint64_t>& wordEnds)
+    {
+        int code[256];
+        fill(code, code + 256, -1);
+        int count = 0;
+        for (size_t i = 0, w = 0; i < text.size(); i++)
+        {
+            if (i + 1 == wordEnds[w])
+            {
+                w++;
+                continue;
+            }
+            unsigned char c = text[i];
+            if (code[c] < 0)
+            {
+                if (count == 4)
+                    return false;
+                bytes[count] = c;
+                code[c] = count++;
+            }
+        }
+        for (; count < 4; count++)
+            bytes[count] = bytes[0];
+
+        length = text.size();
+        codes.assign((length + 31) / 32, 0);
+        ends.assign((length + 63) / 64, 0);
+        endRanks.assign(ends.size(), 0);
+        for (size_t i = 0, w = 0; i < length; i++)
+            if (i + 1 == wordEnds[w])
+            {
+                ends[i / 64] |= uint64_t(1) << (i % 64);
+                w++;
+            }
+            else
+            {
+                codes[i / 32] |= uint64_t(code[(unsigned char)text[i]]) << (2 * (i % 32));
+            }
+        for (size_t b = 1; b < ends.size(); b++)
+            endRanks[b] = endRanks[b - 1] + __builtin_popcountll(ends[b - 1]);
+        return true;
+    }
+
+    size_t size() const { return length; }
+    const int* alphabet() const { return bytes; }
+
+    int operator[](size_t i) const
+    {
+        uint64_t bit = uint64_t(1) << (i % 64);
+        if (ends[i / 64] & bit)
+            return TERMINATOR + endRanks[i / 64] +
+                   __builtin_popcountll(ends[i / 64] & (bit - 1));
+        return bytes[(codes[i / 32] >> (2 * (i % 32))) & 3];
+    }
+
+private:
+    size_t length;
+    int bytes[4];
+    vector<uint64_t> codes;
+    vector<uint64_t> ends;
+    vector<int> endRanks;
+};
+
+// The whole text, instead of s, if it packs.
+PackedText packed;
+bool packedText = false;
+
+inline int symbol(int i)
+{
+    return packedText ? packed[i] : s[i & textMask];
+}
+
+inline size_t textLength()
+{
+    return packedText ? packed.size() : s.size();
+}
+
+// Leaf edges and leaf depths are open: a leaf reaches the end of the
+// text, however long the text grows.
+const int OPEN = INT_MAX;
+
+// All nodes, the root first. The tree of n symbols has at most 2n + 1.
+vector<Node> nodes;
+
+// What only the window mode needs. The label of an internal node is
+// kept at a recent occurrence, so that it stays inside the window: a
+// node passes the occurrences it gets on to its parent every second
+// time (Larsson, "Extended application of suffix trees to data
+// compression"), which costs O(1) amortized per symbol.
+struct Window
+{
+    Window() : size(0) {}
+
+    int size;               // 0 if the whole text is kept.
+    vector<char> credits;   // Whether a node holds an occurrence to pass on.
+    vector<int> childCount;
+    vector<int> childXor;   // The child of a node with only one.
+    vector<int> leafOf;     // Leaf of the suffix at a position, a ring as s.
+    vector<int> freeNodes;
+};
+
+Window window;
+
+int addNode(int parent, int depth, int start)
+{
+    if (!window.freeNodes.empty())
+    {
+        int node = window.freeNodes.back();
+        window.freeNodes.pop_back();
+        nodes[node] = Node(parent, depth, start);
+        window.credits[node] = 0;
+        window.childCount[node] = window.childXor[node] = 0;
+        return node;
+    }
+    nodes.push_back(Node(parent, depth, start));
+    if (window.size)
+    {
+        window.credits.push_back(0);
+        window.childCount.push_back(0);
+        window.childXor.push_back(0);
+    }
+    return int(nodes.size()) - 1;
+}
+
+// Child bookkeeping of the window mode.
+void linkChild(int parent, int child)
+{
+    if (window.size)
+    {
+        window.childCount[parent]++;
+        window.childXor[parent] ^= child;
+    }
+}
+
+void unlinkChild(int parent, int child)
+{
+    if (window.size)
+    {
+        window.childCount[parent]--;
+        window.childXor[parent] ^= child;
+    }
+}
 
 // Edge represents the connection between nodes in a tree.
 // Edge always has 2 nodes on it's both sides.
@@ -59,20 +239,21 @@ struct Edge
 {
     Edge() : parentNode(-1) {}  // Not-in-a-tree edge.
     // Edges are created during traversal from active point to end point.
-    Edge(int parent, int left, int right) : left(left),
-                                            right(right),
-                                            parentNode(parent),
-                                            childNode(Node::count++)
-    {
-        nodes[childNode].parent = &nodes[parentNode];
-        nodes[childNode].firstEdgeChar = s[left];
-    }
+    // The new child is a leaf, open to the end of the text.
+    Edge(int parent, int left)
+        : left(left), right(OPEN), parentNode(parent),
+          childNode(addNode(parent, OPEN, left - nodes[parent].depth)) {}
     Edge(int parent, int child,
          int left, int right) : left(left), right(right),
                                 parentNode(parent), childNode(child)
     {
-        nodes[childNode].parent = &nodes[parentNode];
-        nodes[childNode].firstEdgeChar = s[left];
+        nodes[childNode].parent = parentNode;
+    }
+
+    // The last symbol on the edge.
+    int end() const
+    {
+        return right == OPEN ? front - 1 : right;
     }
 
     // Splits the edge by creating new edge and an init if suffixLink.
@@ -82,32 +263,215 @@ struct Edge
     int parentNode, childNode;
 };
 
-// Any edge can be retrieved by it's parent node
-// and the first character: edges[pair(parent, char)].
-map<pair<int, char>, Edge> edges;
+// Any edge can be retrieved by it's parent node and the first
+// character. The root has an edge for almost every character, so its
+// edges sit in a dense table. All other nodes have few children; their
+// edges share one open addressing table keyed by (parent, char), where
+// a lookup is a hash and usually a single cache line, instead of a walk
+// down a tree of separately allocated map nodes. For a small alphabet,
+// as DNA's, the edges of its symbols are instead in a block of four
+// slots per inner node, found by indexing; only terminators are hashed.
+class EdgeIndex
+{
+public:
+    EdgeIndex() : rootEdges(256), slots(1024), used(0)
+    {
+        fill(smallCode, smallCode + 256, -1);
+    }
+
+    // Keeps the edges beginning with one of the four bytes in blocks.
+    void useSmallAlphabet(const int bytes[4])
+    {
+        for (int i = 0; i < 4; i++)
+            if (smallCode[bytes[i]] < 0)
+                smallCode[bytes[i]] = i;
+    }
+
+    // Null if the node has no edge beginning with c.
+    Edge* find(int node, int c)
+    {
+        if (node == 0 && c < TERMINATOR)
+        {
+            Edge* edge = &rootEdges[c];
+            return edge->parentNode < 0 ? 0 : edge;
+        }
+        if (c < TERMINATOR && smallCode[c] >= 0)
+        {
+            if (size_t(node) >= blockOf.size() || blockOf[node] < 0)
+                return 0;
+            Edge* edge = &blocks[4 * size_t(blockOf[node]) + smallCode[c]];
+            return edge->parentNode < 0 ? 0 : edge;
+        }
+        uint64_t key = makeKey(node, c);
+        for (size_t i = hash(key);; i = (i + 1) & (slots.size() - 1))
+        {
+            if (slots[i].key == key)
+                return &slots[i].edge;
+            if (slots[i].key == EMPTY)
+                return 0;
+        }
+    }
+
+    // Adds or replaces the edge. Pointers returned by find() are
+    // invalidated when the table grows.
+    void insert(int node, int c, const Edge& edge)
+    {
+        if (node == 0 && c < TERMINATOR)
+        {
+            rootEdges[c] = edge;
+            return;
+        }
+        if (c < TERMINATOR && smallCode[c] >= 0)
+        {
+            if (size_t(node) >= blockOf.size())
+                blockOf.resize(max(size_t(node) + 1, 2 * blockOf.size()), -1);
+            if (blockOf[node] < 0)
+            {
+                blockOf[node] = int(blocks.size() / 4);
+                blocks.resize(blocks.size() + 4);
+            }
+            blocks[4 * size_t(blockOf[node]) + smallCode[c]] = edge;
+            return;
+        }
+        // Keep the load at most 1/2, so probe sequences stay short.
+        if (2 * (used + 1) > slots.size())
+            grow();
+        Slot& slot = place(makeKey(node, c));
+        slot.edge = edge;
+    }
+
+    // Removes the edge, which must be there. Later entries of its probe
+    // sequence move back into the gap, so lookups need no tombstones.
+    // Invalidates the pointers returned by find().
+    void erase(int node, int c)
+    {
+        if (node == 0 && c < TERMINATOR)
+        {
+            rootEdges[c] = Edge();
+            return;
+        }
+        if (c < TERMINATOR && smallCode[c] >= 0)
+        {
+            blocks[4 * size_t(blockOf[node]) + smallCode[c]] = Edge();
+            return;
+        }
+        size_t mask = slots.size() - 1;
+        size_t gap = hash(makeKey(node, c));
+        while (slots[gap].key != makeKey(node, c))
+            gap = (gap + 1) & mask;
+        for (size_t i = (gap + 1) & mask; slots[i].key != EMPTY; i = (i + 1) & mask)
+        {
+            // An entry may fill the gap if its home is not after the gap
+            // on the way to it.
+            size_t home = hash(slots[i].key);
+            if (((i - home) & mask) >= ((i - gap) & mask))
+            {
+                slots[gap] = slots[i];
+                gap = i;
+            }
+        }
+        slots[gap].key = EMPTY;
+        used--;
+    }
+
+    // Calls visit with every edge.
+    template <class Visit>
+    void forEach(Visit visit)
+    {
+        for (size_t i = 0; i < rootEdges.size(); i++)
+            if (rootEdges[i].parentNode >= 0)
+                visit(rootEdges[i]);
+        for (size_t i = 0; i < blocks.size(); i++)
+            if (blocks[i].parentNode >= 0)
+                visit(blocks[i]);
+        for (size_t i = 0; i < slots.size(); i++)
+            if (slots[i].key != EMPTY)
+                visit(slots[i].edge);
+    }
+
+private:
+    static const uint64_t EMPTY = ~uint64_t(0);
+
+    struct Slot
+    {
+        Slot() : key(EMPTY) {}
+
+        uint64_t key;
+        Edge edge;
+    };
+
+    static uint64_t makeKey(int node, int c)
+    {
+        return (uint64_t(node) << 32) | uint32_t(c);
+    }
+
+    size_t hash(uint64_t key) const
+    {
+        return size_t((key * 0x9E3779B97F4A7C15ull) >> 32) & (slots.size() - 1);
+    }
 
-// Current edge already identifies itself in edges map
+    // The slot of the key, claimed if the key is new.
+    Slot& place(uint64_t key)
+    {
+        size_t i = hash(key);
+        while (slots[i].key != key && slots[i].key != EMPTY)
+            i = (i + 1) & (slots.size() - 1);
+        if (slots[i].key == EMPTY)
+        {
+            slots[i].key = key;
+            used++;
+        }
+        return slots[i];
+    }
+
+    void grow()
+    {
+        vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        used = 0;
+        for (size_t i = 0; i < old.size(); i++)
+            if (old[i].key != EMPTY)
+                place(old[i].key).edge = old[i].edge;
+    }
+
+    vector<Edge> rootEdges;
+    vector<Slot> slots;
+    size_t used;
+    int smallCode[256];  // Slot of a byte in a block, -1 if it's hashed.
+    vector<int> blockOf; // Block of a node, -1 if it has none.
+    vector<Edge> blocks;
+};
+
+
+EdgeIndex edges;
+
+// Current edge already identifies itself in edges index
 // with the pair (parent, firstChar). To leave it valid,
 // the new edge will be descendant of this one.
 int Edge::splitEdge(const ReferencePair& activePoint)
 {
-    int newNode = Node::count++;
+    // newNode is parented from this edge parent. Its label is a prefix
+    // of the suffix being inserted, the most recent occurrence.
+    int span = activePoint.right - activePoint.left + 1;
+    int newNode = addNode(parentNode, nodes[parentNode].depth + span,
+                          activePoint.left - nodes[parentNode].depth);
 
     // Descendant.
-    size_t leftOfNewEdge = left + activePoint.right - activePoint.left + 1;
+    int leftOfNewEdge = left + span;
     Edge newEdge(newNode, childNode, leftOfNewEdge, right);
-    edges[make_pair(newNode, s[leftOfNewEdge])] = newEdge;
+    linkChild(newNode, childNode);
+    unlinkChild(parentNode, childNode);
+    linkChild(parentNode, newNode);
 
     // This edge is shortened.
-    right = left + activePoint.right - activePoint.left;
+    left = activePoint.left;
+    right = activePoint.right;
     childNode = newNode;
 
-    // newNode is parented from this edge parent.
-    nodes[newNode].parent = &nodes[parentNode];
-    nodes[newNode].firstEdgeChar = s[left];
-    nodes[newNode].depth = nodes[parentNode].depth + right - left + 1;
+    // Last, as the insertion may move this edge.
+    edges.insert(newNode, symbol(leftOfNewEdge), newEdge);
 
-    return childNode; // It's not a leaf now.
+    return newNode; // It's not a leaf now.
 }
 
 // Finds the closest ancestor of the node presented
@@ -116,8 +480,8 @@ void ReferencePair::canonize()
 {
     if (implicit())
     {
-        Edge* edge = &edges[make_pair(node, s[left])];
-        int edgeSpan = edge->right - edge->left;   // 0 or bigger.
+        Edge* edge = edges.find(node, symbol(left));
+        int edgeSpan = edge->end() - edge->left;   // 0 or bigger.
         while (edgeSpan <= (right - left))
         {
             left += (edgeSpan + 1);   // So begins the next edge.
@@ -125,35 +489,146 @@ void ReferencePair::canonize()
             // If the path defines implicit node.
             if (left <= right)
             {
-                edge = &edges[make_pair(node, s[left])];
-                edgeSpan = edge->right - edge->left;
+                edge = edges.find(node, symbol(left));
+                edgeSpan = edge->end() - edge->left;
             }
         }
     }
 }
 
+// Moves the label of an internal node to a more recent occurrence.
+void moveLabel(int node, int start)
+{
+    int parent = nodes[node].parent;
+    Edge* edge = edges.find(parent, symbol(start + nodes[parent].depth));
+    edge->left = start + nodes[parent].depth;
+    edge->right = start + nodes[node].depth - 1;
+    nodes[node].start = start;
+}
+
+// Gives the node an occurrence of its label at start, which it keeps if
+// it's more recent than its own and passes on to its parent, with its
+// own if more recent, every second time.
+void sendCredit(int node, int start)
+{
+    while (node != 0)
+    {
+        if (start > nodes[node].start)
+            moveLabel(node, start);
+        if (!window.credits[node])
+        {
+            window.credits[node] = 1;
+            return;
+        }
+        window.credits[node] = 0;
+        start = nodes[node].start;
+        node = nodes[node].parent;
+    }
+}
+
 size_t K;
-size_t wordsSize[10]; // Length of each word.
-const char* terminators[] = {"$", "#", "@", "^", "&", "|", "*", "%", "(", ")"};
-// Leafs for each word.
-map<size_t, list<Node*> > leafGroups;
+// Position after the terminator of each word.
+vector<uint64_t> wordEnds;
+// Leaves in the order they are created, which is the order of the
+// suffixes they end, so the leaves of each word come one after another.
+vector<int> leaves;
 
+// Ukkonen's algorithm is online, so a built tree takes more symbols at
+// any time, at O(1) amortized cost each. In window mode the tree keeps
+// the last symbols only: appending to a full window first evicts the
+// oldest suffix.
 struct STree
 {
-    STree() : currentWord(0) {}
+    STree() : activePoint(0, 0, -1) {}
 
+    // An empty tree; of the last windowSize symbols if that's not 0.
+    void reset(int windowSize = 0);
+    // Builds the tree of s from scratch.
     void buildTree();
+    void append(int symbol);
+    void append(const string& str);
+    // Gives the leaves their depth at the current end of the text.
+    void closeLeaves();
+
     void update(ReferencePair&, size_t);
-    const Edge& findEdge(int, char);
+    void evict();
+    void mergeNode(int node);
+    void renumber();
 
-    int currentWord; // Word that is inserted in the tree for the moment.
+    ReferencePair activePoint;
 };
 
+void STree::reset(int windowSize)
+{
+    nodes.clear();
+    edges = EdgeIndex();
+    leaves.clear();
+    front = tail = 0;
+    activePoint = ReferencePair(0, 0, -1);
+    window = Window();
+    window.size = windowSize;
+    textMask = -1;
+    if (packedText)
+        edges.useSmallAlphabet(packed.alphabet());
+    if (windowSize > 0)
+    {
+        int capacity = 1;
+        while (capacity < windowSize)
+            capacity *= 2;
+        s.assign(capacity, 0);
+        textMask = capacity - 1;
+        window.leafOf.assign(capacity, -1);
+    }
+    addNode(-1, 0, 0); // Root.
+}
+
 void STree::buildTree()
 {
-    ReferencePair activePoint(0, 0, -1);
-    for (size_t i = 0; i < s.size(); i++)
+    reset();
+    nodes.reserve(2 * textLength() + 1);
+    leaves.reserve(textLength());
+
+    for (size_t i = 0; i < textLength(); i++)
+    {
+        front = int(i) + 1;
         update(activePoint, i);
+    }
+}
+
+// Positions are ints, so in window mode, where they grow without end,
+// they are renumbered from time to time by a multiple of the ring size,
+// which leaves every symbol where it is.
+const int RENUMBER_AT = 1 << 30;
+const int MAX_WINDOW = 1 << 28;
+
+void STree::append(int c)
+{
+    if (window.size)
+    {
+        if (front - tail == window.size)
+            evict();
+        if (front == RENUMBER_AT)
+            renumber();
+        s[front & textMask] = c;
+    }
+    else
+    {
+        s.push_back(c);
+    }
+    front++;
+    update(activePoint, front - 1);
+}
+
+void STree::append(const string& str)
+{
+    for (size_t i = 0; i < str.size(); i++)
+        append((unsigned char)str[i]);
+}
+
+void STree::closeLeaves()
+{
+    for (size_t i = 0; i < leaves.size(); i++)
+        nodes[leaves[i]].depth = front - nodes[leaves[i]].start;
 }
 
 // Add new character in a tree by updating boundary path
@@ -167,9 +642,9 @@ void STree::update(ReferencePair& activePoint, size_t i)
         // Is this an end point? (test-and-split)
         if (activePoint.implicit())
         {
-            Edge* edge = &edges[make_pair(activePoint.node, s[activePoint.left])];
-            size_t span = activePoint.right - activePoint.left; // >= 0.
-            if (s[edge->left + span + 1] == s[i])
+            Edge* edge = edges.find(activePoint.node, symbol(activePoint.left));
+            int span = activePoint.right - activePoint.left; // >= 0.
+            if (symbol(edge->left + span + 1) == symbol(i))
                 break;
             // This parent is pointing to it's own parent now.
             parentNode = edge->splitEdge(activePoint);
@@ -177,17 +652,26 @@ void STree::update(ReferencePair& activePoint, size_t i)
         else
         {
             // If an edge begins with s[i] than it's the end point.
-            if (edges.count(make_pair(activePoint.node, s[i])) > 0)
+            if (edges.find(activePoint.node, symbol(i)) != 0)
                 break;
             parentNode = activePoint.node;
         }
 
         // It's not. Create leaf edge.
-        Edge edge(parentNode, i, s.size() - 1);
-        edges[make_pair(parentNode, s[i])] = edge;
+        Edge edge(parentNode, i);
+        edges.insert(parentNode, symbol(i), edge);
 
-        // Collect new leaf in it's group.
-        leafGroups[currentWord].push_back(&nodes[edge.childNode]);
+        int start = nodes[edge.childNode].start;
+        if (window.size)
+        {
+            linkChild(parentNode, edge.childNode);
+            window.leafOf[start & textMask] = edge.childNode;
+            sendCredit(parentNode, start);
+        }
+        else
+        {
+            leaves.push_back(edge.childNode);
+        }
 
         // If the last time we created an internal node
         // make it point with the suffix link to this node.
@@ -201,11 +685,6 @@ void STree::update(ReferencePair& activePoint, size_t i)
         else
             activePoint.node = nodes[activePoint.node].suffixLink;
         activePoint.canonize();
-
-        // Begining of the next word.
-        if (activePoint.node == 0 && !activePoint.implicit() &&
-                                     s[i] == terminators[currentWord][0])
-            currentWord++; // Terminate symbol will be as the next word leaf.
     }
 
     // oldr != root
@@ -217,81 +696,2175 @@ void STree::update(ReferencePair& activePoint, size_t i)
     activePoint.canonize();
 }
 
-bool comp (const Node& a, const Node& b) { return a.depth > b.depth; }
+// Removes the oldest suffix, at tail, from the window. Longer suffixes
+// are gone already and shorter ones are still there, so it ends in a
+// leaf, unless it's the active point's string.
+void STree::evict()
+{
+    int leaf = window.leafOf[tail & textMask];
+    int parent = nodes[leaf].parent;
+    int first = symbol(tail + nodes[parent].depth);
+    window.leafOf[tail & textMask] = -1;
+
+    // The active point is on the leaf's edge if its string occurs only
+    // at tail. Then it occurs nowhere else without the oldest suffix,
+    // so the leaf is given to the active point's suffix instead, and the
+    // active point moves on to the next suffix, as after adding a leaf.
+    if (activePoint.implicit() && activePoint.node == parent &&
+        symbol(activePoint.left) == first)
+    {
+        int start = activePoint.left - nodes[parent].depth;
+        edges.find(parent, first)->left = activePoint.left;
+        nodes[leaf].start = start;
+        window.leafOf[start & textMask] = leaf;
+        tail++;
+        sendCredit(parent, start);
+
+        if (activePoint.node == 0)
+            activePoint.left++;
+        else
+            activePoint.node = nodes[activePoint.node].suffixLink;
+        activePoint.canonize();
+        return;
+    }
+
+    edges.erase(parent, first);
+    unlinkChild(parent, leaf);
+    window.freeNodes.push_back(leaf);
+    tail++;
+    if (parent != 0 && window.childCount[parent] == 1)
+        mergeNode(parent);
+}
 
-int main()
+// Removes an internal node left with one child, joining its edges. No
+// suffix link points to it: a node linking to it would be left with one
+// child as well.
+void STree::mergeNode(int node)
 {
-    cin >> K;
+    int child = window.childXor[node];
+    int parent = nodes[node].parent;
+    edges.erase(node, symbol(nodes[child].start + nodes[node].depth));
+    Edge* edge = edges.find(parent, symbol(nodes[node].start + nodes[parent].depth));
+    edge->childNode = child;
+    edge->left = nodes[child].start + nodes[parent].depth;
+    edge->right = nodes[child].depth == OPEN
+                      ? OPEN
+                      : nodes[child].start + nodes[child].depth - 1;
+    nodes[child].parent = parent;
+    window.childXor[parent] ^= node ^ child;
 
-    if (K == 1)
+    if (activePoint.node == node)
     {
-        string str;
-        cin >> str;
-        cout << str;
-        return 0;
+        activePoint.node = parent;
+        activePoint.left -= nodes[node].depth - nodes[parent].depth;
     }
+    if (window.credits[node])
+        sendCredit(parent, nodes[node].start);
+    window.freeNodes.push_back(node);
+}
 
-    string generalized;
-    for (size_t i = 0; i < K; i++)
+void STree::renumber()
+{
+    int shift = tail & ~textMask;
+    for (size_t i = 1; i < nodes.size(); i++)
+        nodes[i].start -= shift;
+    edges.forEach([shift](Edge& edge)
+                  {
+                      edge.left -= shift;
+                      if (edge.right != OPEN)
+                          edge.right -= shift;
+                  });
+    activePoint.left -= shift;
+    activePoint.right -= shift;
+    front -= shift;
+    tail -= shift;
+}
+
+// Union-find root with path compression.
+template <class Item>
+int findSet(vector<Item>& items, int v)
+{
+    int root = v;
+    while (items[root].link != root)
+        root = items[root].link;
+    while (items[v].link != root)
     {
-        string str;
-        cin >> str;
+        int next = items[v].link;
+        items[v].link = root;
+        v = next;
+    }
+    return root;
+}
+
+// Counts the different words below every node in linear time (Hui,
+// "Color set size problem with applications to string matching"). In
+// DFS order each leaf adds 1 for its word, and the LCA of the leaf and
+// the previous leaf of the same word takes 1 back, so summing over a
+// subtree counts each word once. The LCAs come from Tarjan's offline
+// algorithm: the previous leaf was visited earlier, so its union-find
+// set is named by the LCA, which is still on the DFS stack.
+void countWords()
+{
+    // Everything the DFS needs of a node, in one place, as nodes are
+    // visited in an order unrelated to their indices.
+    struct Visit
+    {
+        int nextChild, endChild; // Range in children.
+        int link;                // Union-find parent.
+        int words;
+        int word;                // Word of a leaf, -1 for internal nodes.
+    };
+    size_t n = nodes.size();
+    vector<Visit> visits(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        visits[i].endChild = 0;
+        visits[i].word = -1;
+    }
 
-        wordsSize[i] = str.size() + 1;
-        s += str + terminators[i];
+    // Children of every node, stored together.
+    vector<int> children(n - 1);
+    for (size_t i = 1; i < n; i++)
+        visits[nodes[i].parent].endChild++;
+    for (size_t i = 0, total = 0; i < n; i++)
+    {
+        size_t count = visits[i].endChild;
+        visits[i].nextChild = visits[i].endChild = int(total);
+        total += count;
     }
+    for (size_t i = 1; i < n; i++)
+        children[visits[nodes[i].parent].endChild++] = int(i);
 
-    STree tree;
-    tree.buildTree();
+    for (size_t i = 0, w = 0; i < leaves.size(); i++)
+    {
+        while (size_t(nodes[leaves[i]].start) >= wordEnds[w])
+            w++;
+        visits[leaves[i]].word = int(w);
+    }
 
-    map<size_t, list<Node*> >::iterator it;
-    for (it = leafGroups.begin(); it != leafGroups.end(); ++it)
+    vector<int> lastLeaf(K, -1);
+    vector<int> path(1, 0);
+    visits[0].link = 0;
+    visits[0].words = 0;
+    while (!path.empty())
     {
-        list<Node*>::iterator leafNode;
-        for (leafNode = it->second.begin(); leafNode != it->second.end(); ++leafNode)
+        int node = path.back();
+        Visit& visit = visits[node];
+        if (visit.nextChild < visit.endChild)
         {
-            Node* node = *leafNode;
-            while (node->parent != 0)
+            int child = children[visit.nextChild++];
+            Visit& leaf = visits[child];
+            leaf.link = child;
+            leaf.words = 0;
+            if (leaf.word >= 0)
             {
-                node = node->parent;
-                node->leafKinds.insert(it->first);
+                leaf.words = 1;
+                int& last = lastLeaf[leaf.word];
+                if (last >= 0)
+                    visits[findSet(visits, last)].words--;
+                last = child;
             }
+            path.push_back(child);
+            continue;
+        }
+        path.pop_back();
+        if (!path.empty())
+        {
+            visits[path.back()].words += visit.words;
+            visit.link = path.back();
         }
     }
 
-    Node* deepestNode = 0;
-    for (size_t i = 0; i < Node::count; i++)
+    for (size_t i = 0; i < n; i++)
+        nodes[i].words = visits[i].words;
+}
+
+// Read-only view of a built tree: the arrays of the tree just built,
+// or of a mapped index file. Children are sorted by the first symbol
+// of their edge, whose label is s[start + parent depth, start + depth).
+struct TreeView
+{
+    // The child whose edge begins with c, -1 if there is none.
+    int child(int node, int c) const
     {
-        if (nodes[i].leafKinds.size() < K)
-            continue;
+        int depth = nodes[node].depth;
+        const int* first = children + childBegin[node];
+        const int* last = children + childBegin[node + 1];
+        while (first < last)
+        {
+            const int* middle = first + (last - first) / 2;
+            if (symbol(nodes[*middle].start + depth) < c)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        if (first == children + childBegin[node + 1] ||
+            symbol(nodes[*first].start + depth) != c)
+            return -1;
+        return *first;
+    }
 
-        if (deepestNode != 0 && nodes[i].depth > deepestNode->depth)
-            deepestNode = &nodes[i];
-        else if (deepestNode == 0)
-            deepestNode = &nodes[i];
+    int symbol(uint64_t i) const
+    {
+        return packed ? (*packed)[i] : s[i];
     }
 
-    if (deepestNode == 0)
-        cout << "";
-    else
+    uint64_t words, symbols, nodeCount;
+    const uint64_t* wordEnds;
+    const int* s;
+    const PackedText* packed; // The text instead of s if not null.
+    const Node* nodes;
+    const int* childBegin; // nodeCount + 1 offsets into children.
+    const int* children;
+    // Suffixes below every node, those beginning with a terminator
+    // left out: the occurrences of the node's label.
+    const int* suffixCounts;
+};
+
+// Children of every node in a flat array, instead of the edge index
+// which is no longer needed once the tree is built.
+vector<int> childBegin, children, suffixCounts;
+
+TreeView flattenTree()
+{
+    edges = EdgeIndex();
+
+    size_t n = nodes.size();
+    childBegin.assign(n + 1, 0);
+    for (size_t i = 1; i < n; i++)
+        childBegin[nodes[i].parent + 1]++;
+    for (size_t i = 0; i < n; i++)
+        childBegin[i + 1] += childBegin[i];
+    children.resize(n - 1);
+    vector<int> next(childBegin.begin(), childBegin.end() - 1);
+    for (size_t i = 1; i < n; i++)
+        children[next[nodes[i].parent]++] = int(i);
+    for (size_t i = 0; i < n; i++)
+    {
+        int depth = nodes[i].depth;
+        sort(children.begin() + childBegin[i],
+             children.begin() + childBegin[i + 1],
+             [depth](int a, int b)
+             {
+                 return symbol(nodes[a].start + depth) < symbol(nodes[b].start + depth);
+             });
+    }
+
+    // Children come after their parent in preorder, so summing in
+    // reverse preorder finishes every node before its parent.
+    vector<int> order(1, 0);
+    order.reserve(n);
+    for (size_t i = 0; i < order.size(); i++)
+        order.insert(order.end(), children.begin() + childBegin[order[i]],
+                     children.begin() + childBegin[order[i] + 1]);
+    suffixCounts.assign(n, 0);
+    for (size_t i = n; i-- > 1;)
+    {
+        int v = order[i];
+        if (childBegin[v] == childBegin[v + 1] && symbol(nodes[v].start) < TERMINATOR)
+            suffixCounts[v] = 1;
+        suffixCounts[nodes[v].parent] += suffixCounts[v];
+    }
+
+    TreeView view;
+    view.words = K;
+    view.symbols = textLength();
+    view.nodeCount = n;
+    view.wordEnds = wordEnds.data();
+    view.s = s.data();
+    view.packed = packedText ? &packed : 0;
+    view.nodes = nodes.data();
+    view.childBegin = childBegin.data();
+    view.children = children.data();
+    view.suffixCounts = suffixCounts.data();
+    return view;
+}
+
+// Index file: the header, then the arrays at the offsets it gives,
+// each 8-byte aligned and in the host's byte order, so that the mapped
+// file is used as it is. Processes mapping the same index share it in
+// the page cache.
+struct IndexHeader
+{
+    char magic[4]; // "STIX"
+    uint32_t version;
+    uint64_t words, symbols, nodeCount;
+    uint64_t wordEndsOffset, textOffset, nodesOffset;
+    uint64_t childBeginOffset, childrenOffset, suffixCountsOffset;
+    uint64_t fileSize;
+};
+
+const char INDEX_MAGIC[4] = { 'S', 'T', 'I', 'X' };
+const uint32_t INDEX_VERSION = 2;
+
+static_assert(sizeof(Node) == 5 * sizeof(int), "Node is stored as it is");
+
+uint64_t alignIndex(uint64_t offset)
+{
+    return (offset + 7) & ~uint64_t(7);
+}
+
+// The header of an index of these sizes, with its arrays laid out.
+IndexHeader indexLayout(uint64_t words, uint64_t symbols, uint64_t nodeCount)
+{
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.words = words;
+    header.symbols = symbols;
+    header.nodeCount = nodeCount;
+    header.wordEndsOffset = alignIndex(sizeof(header));
+    header.textOffset = alignIndex(header.wordEndsOffset +
+                                   words * sizeof(uint64_t));
+    header.nodesOffset = alignIndex(header.textOffset +
+                                    symbols * sizeof(int));
+    header.childBeginOffset = alignIndex(header.nodesOffset +
+                                         nodeCount * sizeof(Node));
+    header.childrenOffset = alignIndex(header.childBeginOffset +
+                                       (nodeCount + 1) * sizeof(int));
+    header.suffixCountsOffset = alignIndex(header.childrenOffset +
+                                           (nodeCount - 1) * sizeof(int));
+    header.fileSize = header.suffixCountsOffset + nodeCount * sizeof(int);
+    return header;
+}
+
+bool writeIndex(const string& fileName, const TreeView& view)
+{
+    IndexHeader header = indexLayout(view.words, view.symbols, view.nodeCount);
+
+    ofstream out(fileName.c_str(), ios::binary | ios::trunc);
+    uint64_t offset = 0;
+    auto put = [&](uint64_t at, const void* data, uint64_t size)
+    {
+        static const char padding[8] = {};
+        out.write(padding, at - offset);
+        out.write(static_cast<const char*>(data), size);
+        offset = at + size;
+    };
+    put(0, &header, sizeof(header));
+    put(header.wordEndsOffset, view.wordEnds, view.words * sizeof(uint64_t));
+    if (view.packed)
     {
-        stack<char> path;
-        while (deepestNode->parent)
+        // Unpacked, as the index keeps an int a symbol.
+        vector<int> symbols(min(view.symbols, uint64_t(1) << 16));
+        for (uint64_t i = 0; i < view.symbols; i += symbols.size())
         {
-            path.push(deepestNode->firstEdgeChar);
-            deepestNode = deepestNode->parent;
+            size_t count = min(uint64_t(symbols.size()), view.symbols - i);
+            for (size_t k = 0; k < count; k++)
+                symbols[k] = view.symbol(i + k);
+            put(header.textOffset + i * sizeof(int), symbols.data(),
+                count * sizeof(int));
         }
+    }
+    else
+    {
+        put(header.textOffset, view.s, view.symbols * sizeof(int));
+    }
+    put(header.nodesOffset, view.nodes, view.nodeCount * sizeof(Node));
+    put(header.childBeginOffset, view.childBegin,
+        (view.nodeCount + 1) * sizeof(int));
+    put(header.childrenOffset, view.children,
+        (view.nodeCount - 1) * sizeof(int));
+    put(header.suffixCountsOffset, view.suffixCounts,
+        view.nodeCount * sizeof(int));
+    out.close();
+    return !out.fail();
+}
+
+// A mapping of a whole file, unmapped on destruction.
+class MappedFile
+{
+public:
+    MappedFile() : data(0), size(0) {}
+    ~MappedFile()
+    {
+        if (data)
+            munmap(data, size);
+    }
 
-        int node = 0; // Root.
-        while (!path.empty())
+    // False if the file cannot be mapped; writes go to the file.
+    bool open(const string& fileName, bool writable = false)
+    {
+        int fd = ::open(fileName.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        size = size_t(status.st_size);
+        data = mmap(0, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                    MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
         {
-            Edge* edge = &edges[make_pair(node, path.top())];
+            data = 0;
+            return false;
+        }
+        return true;
+    }
 
-            for (int i = edge->left; i <= edge->right; i++)
-                cout << s[i];
+    void* data;
+    size_t size;
 
-            path.pop();
-            node = edge->childNode;
-        }
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+// A read-only mapping of an index file.
+class MappedIndex
+{
+public:
+    // False if the file cannot be mapped or is not a valid index.
+    bool open(const string& fileName, TreeView& view)
+    {
+        if (!file.open(fileName) || file.size < sizeof(IndexHeader))
+            return false;
+        size_t size = file.size;
+
+        const char* base = static_cast<const char*>(file.data);
+        IndexHeader header;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != INDEX_VERSION || header.fileSize != size ||
+            header.nodeCount == 0)
+            return false;
+        // Offsets must be aligned and the arrays inside the file.
+        uint64_t offsets[] = { header.wordEndsOffset, header.textOffset,
+                               header.nodesOffset, header.childBeginOffset,
+                               header.childrenOffset,
+                               header.suffixCountsOffset, header.fileSize };
+        uint64_t sizes[] = { header.words * sizeof(uint64_t),
+                             header.symbols * sizeof(int),
+                             header.nodeCount * sizeof(Node),
+                             (header.nodeCount + 1) * sizeof(int),
+                             (header.nodeCount - 1) * sizeof(int),
+                             header.nodeCount * sizeof(int) };
+        if (header.symbols > uint64_t(INT_MAX / 2) ||
+            header.nodeCount > 2 * header.symbols + 1 ||
+            header.words > header.symbols)
+            return false;
+        for (size_t i = 0; i < 6; i++)
+            if (offsets[i] % 8 != 0 || offsets[i] < sizeof(header) ||
+                offsets[i] + sizes[i] > offsets[i + 1])
+                return false;
+
+        view.words = header.words;
+        view.symbols = header.symbols;
+        view.nodeCount = header.nodeCount;
+        view.wordEnds = reinterpret_cast<const uint64_t*>(base + header.wordEndsOffset);
+        view.s = reinterpret_cast<const int*>(base + header.textOffset);
+        view.packed = 0;
+        view.nodes = reinterpret_cast<const Node*>(base + header.nodesOffset);
+        view.childBegin = reinterpret_cast<const int*>(base + header.childBeginOffset);
+        view.children = reinterpret_cast<const int*>(base + header.childrenOffset);
+        view.suffixCounts = reinterpret_cast<const int*>(base + header.suffixCountsOffset);
+        return true;
+    }
+
+private:
+    MappedFile file;
+};
+
+// External memory construction of the index, for inputs whose tree
+// does not fit in memory. The numbered text goes to a file, and its
+// suffix array and LCP values are built in files by external merge
+// sorts, which read and write them in sequence. One scan of these builds
+// the tree bottom up, as in Abouelhoda, Kurtz & Ohlebusch's enhanced
+// suffix arrays, right into the mapped index file. In memory are only
+// the sorts' runs and buffers, the top of the stack of open nodes, which
+// spills to a file on repetitive text, and a counter per word; the rest
+// is file pages that the kernel writes back instead of swapping. The
+// index has no suffix links: matching statistics restart at the root
+// instead.
+
+// Buffered reading of a file of records.
+template <class T>
+class RecordReader
+{
+public:
+    RecordReader(const string& fileName, size_t bufferRecords)
+        : file(fopen(fileName.c_str(), "rb")), buffer(bufferRecords),
+          position(0), size(0) {}
+    ~RecordReader()
+    {
+        if (file)
+            fclose(file);
+    }
+
+    bool good() const { return file != 0; }
+
+    // Moves count records on.
+    bool skip(size_t count)
+    {
+        return fseeko(file, off_t(count * sizeof(T)), SEEK_CUR) == 0;
+    }
+
+    // False at the end of the file.
+    bool next(T& record)
+    {
+        if (position == size)
+        {
+            size = fread(buffer.data(), sizeof(T), buffer.size(), file);
+            position = 0;
+            if (size == 0)
+                return false;
+        }
+        record = buffer[position++];
+        return true;
+    }
+
+private:
+    RecordReader(const RecordReader&);
+    RecordReader& operator=(const RecordReader&);
+
+    FILE* file;
+    vector<T> buffer;
+    size_t position, size;
+};
+
+// Buffered writing of a file of records.
+template <class T>
+class RecordWriter
+{
+public:
+    RecordWriter(const string& fileName, size_t bufferRecords)
+        : file(fopen(fileName.c_str(), "wb")), failed(file == 0)
+    {
+        buffer.reserve(bufferRecords);
+    }
+    ~RecordWriter() { close(); }
+
+    void put(const T& record)
+    {
+        buffer.push_back(record);
+        if (buffer.size() == buffer.capacity())
+            flush();
+    }
+
+    // False if any write failed.
+    bool close()
+    {
+        if (file)
+        {
+            flush();
+            failed = fclose(file) != 0 || failed;
+            file = 0;
+        }
+        return !failed;
+    }
+
+private:
+    RecordWriter(const RecordWriter&);
+    RecordWriter& operator=(const RecordWriter&);
+
+    void flush()
+    {
+        if (!buffer.empty() && !failed &&
+            fwrite(buffer.data(), sizeof(T), buffer.size(), file) != buffer.size())
+            failed = true;
+        buffer.clear();
+    }
+
+    FILE* file;
+    bool failed;
+    vector<T> buffer;
+};
+
+// External merge sort of the records of a file into another in about
+// memory bytes: sorted runs of half of it, merged by as many at a time
+// as have buffers of at least 64 KiB in the other half.
+template <class T, class Less>
+bool externalSort(const string& in, const string& out, Less less,
+                  size_t memory)
+{
+    const size_t MIN_BUFFER = (1 << 16) / sizeof(T);
+    size_t runLength = max(memory / 2 / sizeof(T), MIN_BUFFER);
+    size_t fanIn = max(memory / 2 / sizeof(T) / MIN_BUFFER, size_t(2));
+    vector<string> runs;
+    {
+        RecordReader<T> reader(in, MIN_BUFFER);
+        if (!reader.good())
+            return false;
+        vector<T> run;
+        run.reserve(runLength);
+        T record;
+        bool more = reader.next(record);
+        while (more || runs.empty())
+        {
+            run.clear();
+            for (; more && run.size() < runLength; more = reader.next(record))
+                run.push_back(record);
+            sort(run.begin(), run.end(), less);
+            runs.push_back(out + ".run" + to_string(runs.size()));
+            RecordWriter<T> writer(runs.back(), MIN_BUFFER);
+            for (size_t i = 0; i < run.size(); i++)
+                writer.put(run[i]);
+            if (!writer.close())
+                return false;
+        }
+    }
+
+    // Each pass merges groups of runs, the last one into out.
+    for (size_t pass = 0; runs.size() > 1; pass++)
+    {
+        vector<string> merged;
+        for (size_t first = 0; first < runs.size(); first += fanIn)
+        {
+            size_t count = min(fanIn, runs.size() - first);
+            size_t bufferRecords = memory / 2 / sizeof(T) / (count + 1);
+            merged.push_back(runs.size() <= fanIn ? out
+                             : out + ".run" + to_string(pass) + "." +
+                               to_string(merged.size()));
+            vector<unique_ptr<RecordReader<T>>> readers;
+            vector<T> heads(count);
+            vector<size_t> heap;
+            auto later = [&](size_t a, size_t b) { return less(heads[b], heads[a]); };
+            for (size_t r = 0; r < count; r++)
+            {
+                readers.emplace_back(new RecordReader<T>(runs[first + r],
+                                                         max(bufferRecords, MIN_BUFFER)));
+                if (!readers[r]->good())
+                    return false;
+                if (readers[r]->next(heads[r]))
+                    heap.push_back(r);
+            }
+            make_heap(heap.begin(), heap.end(), later);
+            RecordWriter<T> writer(merged.back(), max(bufferRecords, MIN_BUFFER));
+            while (!heap.empty())
+            {
+                pop_heap(heap.begin(), heap.end(), later);
+                size_t r = heap.back();
+                writer.put(heads[r]);
+                if (readers[r]->next(heads[r]))
+                    push_heap(heap.begin(), heap.end(), later);
+                else
+                    heap.pop_back();
+            }
+            if (!writer.close())
+                return false;
+            for (size_t r = 0; r < count; r++)
+                remove(runs[first + r].c_str());
+        }
+        runs.swap(merged);
+    }
+    return runs[0] == out || rename(runs[0].c_str(), out.c_str()) == 0;
+}
+
+struct RankPair
+{
+    int first, second; // Ranks of the suffix and the one h further on.
+    int position;
+};
+
+struct KeyValue
+{
+    int key, value;
+};
+
+bool sortByKey(const string& in, const string& out, size_t memory)
+{
+    return externalSort<KeyValue>(in, out,
+                                  [](const KeyValue& a, const KeyValue& b)
+                                  { return a.key < b.key; }, memory);
+}
+
+// Writes the suffix array of the n symbols of text to fileName + ".sa"
+// and their LCP values to fileName + ".lcp", in about memory bytes, by
+// prefix doubling: each round sorts the suffixes by the ranks of their
+// first h symbols and of the h after, and sorts the new ranks back into
+// text order. The ranks of each round stay on disk, 4 bytes a symbol
+// for each doubling up to the longest repeat, for the LCP values: from
+// the longest h down, neighbours in the suffix array that have the same
+// rank by h symbols where their match so far ends match h more. Each of
+// these rounds looks the ranks up by sorting the places by position,
+// merging them with the ranks and sorting them back, so that nothing
+// reads the text or the ranks out of order.
+bool externalSuffixArray(const int* text, int n, size_t memory,
+                         const string& fileName)
+{
+    size_t bufferRecords = max(memory / 16 / sizeof(RankPair), size_t(1) << 12);
+    string ranks = fileName + ".ranks", pairs = fileName + ".pairs",
+           sorted = fileName + ".sorted", named = fileName + ".named",
+           lcps = fileName + ".lcp", suffixArray = fileName + ".sa";
+    auto ranksBy = [&](int level) { return fileName + ".ranks" + to_string(level); };
+    // Rounds up to levels have left their ranks.
+    int levels = 0;
+    auto finish = [&](bool ok)
+    {
+        for (int level = 0; level <= levels; level++)
+            remove(ranksBy(level).c_str());
+        remove(ranks.c_str());
+        remove(pairs.c_str());
+        remove(sorted.c_str());
+        remove(named.c_str());
+        return ok;
+    };
+    {
+        RecordWriter<KeyValue> out(ranks, bufferRecords);
+        for (int i = 0; i < n; i++)
+            out.put(KeyValue{ i, text[i] });
+        if (!out.close())
+            return finish(false);
+    }
+    for (int h = 1, groups = 0; groups < n; h *= 2, levels++)
+    {
+        {
+            RecordReader<KeyValue> rank(ranks, bufferRecords),
+                                   later(ranks, bufferRecords);
+            RecordWriter<RankPair> out(pairs, bufferRecords);
+            RecordWriter<int> kept(ranksBy(levels), bufferRecords);
+            if (!rank.good() || !later.good() || !later.skip(h))
+                return finish(false);
+            KeyValue r, l;
+            for (int i = 0; i < n && rank.next(r); i++)
+            {
+                out.put(RankPair{ r.value,
+                                  i + h < n && later.next(l) ? l.value : -1, i });
+                kept.put(r.value);
+            }
+            if (!out.close() || !kept.close())
+                return finish(false);
+        }
+        if (!externalSort<RankPair>(pairs, sorted,
+                                    [](const RankPair& a, const RankPair& b)
+                                    {
+                                        return a.first != b.first ? a.first < b.first
+                                                                  : a.second < b.second;
+                                    }, memory))
+            return finish(false);
+
+        // The new rank of a suffix is the place of the first one with
+        // the same 2h symbols.
+        groups = 0;
+        {
+            RecordReader<RankPair> in(sorted, bufferRecords);
+            RecordWriter<KeyValue> out(named, bufferRecords);
+            RecordWriter<int> suffixes(suffixArray, bufferRecords);
+            RankPair pair, previous = { -2, -2, 0 };
+            int name = 0;
+            for (int i = 0; in.next(pair); i++)
+            {
+                if (pair.first != previous.first || pair.second != previous.second)
+                {
+                    name = i;
+                    groups++;
+                }
+                out.put(KeyValue{ pair.position, name });
+                suffixes.put(pair.position);
+                previous = pair;
+            }
+            if (!out.close() || !suffixes.close())
+                return finish(false);
+        }
+        if (!sortByKey(named, ranks, memory))
+            return finish(false);
+    }
+
+    // All suffixes differ after h symbols of the last round, so the LCP
+    // values are sums of distinct smaller powers of two.
+    {
+        RecordWriter<int> out(lcps, bufferRecords);
+        for (int i = 0; i < n; i++)
+            out.put(0);
+        if (!out.close())
+            return finish(false);
+    }
+    while (levels-- > 0)
+    {
+        // Place 2i asks for the rank after the match of the suffix
+        // before the ith, place 2i + 1 for that of the ith.
+        {
+            RecordReader<int> suffixes(suffixArray, bufferRecords), lcp(lcps, bufferRecords);
+            RecordWriter<KeyValue> out(named, bufferRecords);
+            if (!suffixes.good() || !lcp.good())
+                return finish(false);
+            int previous = 0, suffix, match;
+            for (int i = 0; suffixes.next(suffix) && lcp.next(match); i++)
+            {
+                // Terminators are all different, so the match stops
+                // before the end of the text.
+                if (i > 0)
+                {
+                    out.put(KeyValue{ previous + match, 2 * i });
+                    out.put(KeyValue{ suffix + match, 2 * i + 1 });
+                }
+                previous = suffix;
+            }
+            if (!out.close() || !sortByKey(named, sorted, memory))
+                return finish(false);
+        }
+        {
+            RecordReader<KeyValue> in(sorted, bufferRecords);
+            RecordReader<int> rank(ranksBy(levels), bufferRecords);
+            RecordWriter<KeyValue> out(named, bufferRecords);
+            if (!in.good() || !rank.good())
+                return finish(false);
+            KeyValue query;
+            int position = -1, value = 0;
+            while (in.next(query))
+            {
+                while (position < query.key && rank.next(value))
+                    position++;
+                out.put(KeyValue{ query.value, value });
+            }
+            if (!out.close() || !sortByKey(named, sorted, memory))
+                return finish(false);
+        }
+        {
+            RecordReader<KeyValue> in(sorted, bufferRecords);
+            RecordReader<int> lcp(lcps, bufferRecords);
+            RecordWriter<int> out(pairs, bufferRecords);
+            if (!in.good() || !lcp.good())
+                return finish(false);
+            KeyValue before, at;
+            for (int i = 0, match; lcp.next(match); i++)
+            {
+                if (i > 0 && in.next(before) && in.next(at) &&
+                    before.value == at.value)
+                    match += 1 << levels;
+                out.put(match);
+            }
+            if (!out.close() || rename(pairs.c_str(), lcps.c_str()) != 0)
+                return finish(false);
+        }
+        remove(ranksBy(levels).c_str());
+    }
+    return finish(true);
+}
+
+// A stack of about records records in memory: the rest goes to a file
+// half of them at a time, and comes back when the top runs out, so the
+// top is always in memory. Records on file can be found, not changed.
+template <class T>
+class SpillStack
+{
+public:
+    SpillStack(const string& fileName, size_t records)
+        : fileName(fileName), file(0), block(max(records / 2, size_t(1))),
+          cached(SIZE_MAX), failed(false) {}
+    ~SpillStack()
+    {
+        if (file)
+        {
+            fclose(file);
+            remove(fileName.c_str());
+        }
+    }
+
+    // False if any read or write failed.
+    bool good() const { return !failed; }
+    bool empty() const { return top.empty(); }
+    T& back() { return top.back(); }
+
+    void push(const T& record)
+    {
+        if (top.size() == 2 * block)
+        {
+            if (!file)
+                file = fopen(fileName.c_str(), "w+b");
+            failed = failed || !file ||
+                     fseeko(file, off_t(firsts.size() * block * sizeof(T)), SEEK_SET) != 0 ||
+                     fwrite(top.data(), sizeof(T), block, file) != block;
+            firsts.push_back(top[0]);
+            top.erase(top.begin(), top.begin() + block);
+        }
+        top.push_back(record);
+    }
+
+    void pop()
+    {
+        top.pop_back();
+        if (top.empty() && !firsts.empty())
+        {
+            firsts.pop_back();
+            failed = !read(firsts.size(), top) || failed;
+            if (cached >= firsts.size())
+                cached = SIZE_MAX;
+        }
+    }
+
+    // The last record that below holds for, given that it holds for the
+    // bottom one and for none after the first it does not hold for.
+    template <class Below>
+    const T& find(Below below)
+    {
+        const vector<T>* records = &top;
+        if (!firsts.empty() && !below(top[0]))
+        {
+            size_t b = partition_point(firsts.begin(), firsts.end(), below) -
+                       firsts.begin() - 1;
+            if (b != cached)
+            {
+                cached = b;
+                failed = failed || !read(b, spilled);
+            }
+            records = &spilled;
+        }
+        return *(partition_point(records->begin(), records->end(), below) - 1);
+    }
+
+private:
+    SpillStack(const SpillStack&);
+    SpillStack& operator=(const SpillStack&);
+
+    bool read(size_t b, vector<T>& records)
+    {
+        records.resize(block);
+        return file && fseeko(file, off_t(b * block * sizeof(T)), SEEK_SET) == 0 &&
+               fread(records.data(), sizeof(T), block, file) == block;
+    }
+
+    string fileName;
+    FILE* file;
+    size_t block;       // Records moved to or from the file at a time.
+    vector<T> top;
+    vector<T> firsts;   // The first record of each block on file.
+    vector<T> spilled;  // The block on file find() read last,
+    size_t cached;      // which is this one.
+    bool failed;
+};
+
+// The tree from the suffix array and LCP values: each LCP interval
+// [lb, rb] of depth d, where the suffixes share d symbols and no more
+// around it, is an internal node, and each suffix a leaf. Node 0 is the
+// root, 1 + i the leaf of the ith suffix, and the internal nodes follow
+// in the order they are opened. The first scan writes the nodes, word
+// and suffix counts and the child counts, the second the children now
+// that the places of their lists are known; both attach them to their
+// parents in suffix order, that is by first symbol. The writes are not
+// in order, but they only go to the next leaf and to the open nodes, and
+// their child lists, which have increasing ids up the stack: a page is
+// done with once its nodes are closed, and until then it is page cache
+// the kernel can write back, not memory of the build.
+class IndexBuilder
+{
+public:
+    IndexBuilder(const string& fileName, size_t bufferInts, int n,
+                 Node* nodes, int* childBegin, int* children,
+                 int* suffixCounts)
+        : fileName(fileName), bufferInts(bufferInts), n(n), nodes(nodes),
+          childBegin(childBegin), children(children),
+          suffixCounts(suffixCounts) {}
+
+    // The number of internal nodes, the root included, or 0 on failure.
+    static int internalNodes(const string& fileName, size_t bufferInts)
+    {
+        RecordReader<int> lcps(fileName + ".lcp", bufferInts);
+        SpillStack<int> depths(fileName + ".depths", bufferInts);
+        if (!lcps.good())
+            return 0;
+        depths.push(0);
+        int count = 1, lcp;
+        while (lcps.next(lcp))
+        {
+            while (lcp < depths.back())
+                depths.pop();
+            if (lcp > depths.back())
+            {
+                depths.push(lcp);
+                count++;
+            }
+        }
+        return depths.good() ? count : 0;
+    }
+
+    bool scan(bool fillChildren)
+    {
+        RecordReader<int> suffixes(fileName + ".sa", bufferInts);
+        RecordReader<int> lcps(fileName + ".lcp", bufferInts);
+        SpillStack<Interval> stack(fileName + ".open",
+                                   bufferInts * sizeof(int) / sizeof(Interval));
+        if (!suffixes.good() || !lcps.good())
+            return false;
+        this->fillChildren = fillChildren;
+        open = &stack;
+        // Hui's count: each leaf adds its word to its ancestors, but the
+        // deepest common one with the last leaf of the word takes it off,
+        // in its node, as it may be on file.
+        vector<int> lastLeaf(fillChildren ? 0 : K, -1);
+        open->push(Interval(0, 0, 0, 0));
+        int nextId = n + 1;
+        Interval last(0, 0, 0, 0);
+        for (int i = 0; i < n; i++)
+        {
+            int suffix, lcp;
+            if (!suffixes.next(suffix) || !lcps.next(lcp))
+                return false;
+            if (i > 0)
+            {
+                close(lcp, last);
+                if (lcp > open->back().depth)
+                    open->push(Interval(lcp, last.lb, nextId++, last.start));
+                attach(last);
+            }
+            last = Interval(n - suffix, i, 1 + i, suffix);
+            last.words = 1;
+            // Terminators come after all other symbols, so the last K
+            // suffixes are the ones that start with one.
+            last.suffixes = i < n - int(K);
+            if (fillChildren)
+                continue;
+
+            size_t word = upper_bound(wordEnds.begin(), wordEnds.end(),
+                                      uint64_t(suffix)) - wordEnds.begin();
+            if (lastLeaf[word] >= 0)
+            {
+                int lb = lastLeaf[word];
+                nodes[open->find([lb](const Interval& v) { return v.lb <= lb; }).id].words--;
+            }
+            lastLeaf[word] = i;
+        }
+        close(0, last);
+        attach(last);
+        if (!fillChildren)
+        {
+            int words = open->back().words + nodes[0].words;
+            nodes[0] = Node(-1, 0, 0);
+            nodes[0].words = words;
+            suffixCounts[0] = open->back().suffixes;
+        }
+        return open->good();
+    }
+
+private:
+    struct Interval
+    {
+        Interval(int depth = 0, int lb = 0, int id = 0, int start = 0)
+            : depth(depth), lb(lb), id(id), start(start), words(0),
+              suffixes(0) {}
+
+        int depth, lb, id, start, words, suffixes;
+    };
+
+    // Closes the open intervals deeper than depth; last is the node
+    // whose parent comes next, and becomes the last one closed.
+    void close(int depth, Interval& last)
+    {
+        while (depth < open->back().depth)
+        {
+            attach(last);
+            last = open->back();
+            open->pop();
+        }
+    }
+
+    void attach(const Interval& child)
+    {
+        Interval& parent = open->back();
+        if (fillChildren)
+        {
+            children[childBegin[parent.id]++] = child.id;
+            return;
+        }
+        // The node has the corrections to its count, zeros before.
+        int words = child.words + nodes[child.id].words;
+        nodes[child.id] = Node(parent.id, child.depth, child.start);
+        nodes[child.id].words = words;
+        suffixCounts[child.id] = child.suffixes;
+        childBegin[parent.id + 1]++;
+        parent.words += words;
+        parent.suffixes += child.suffixes;
+    }
+
+    string fileName;
+    size_t bufferInts;
+    int n;
+    Node* nodes;
+    int* childBegin;
+    int* children;
+    int* suffixCounts;
+    bool fillChildren;
+    SpillStack<Interval>* open;
+};
+
+// Builds the index of the words read from stdin in fileName in about memory
+// bytes, keeping temporary files next to it. An error message, or empty.
+string buildIndexExternally(const string& fileName, size_t memory)
+{
+    size_t bufferInts = max(memory / 16 / sizeof(int), size_t(1) << 14);
+    string textFile = fileName + ".text";
+    {
+        RecordWriter<int> out(textFile, bufferInts);
+        // The words go straight to the file, however long they are.
+        streambuf* in = cin.rdbuf();
+        const int END = char_traits<char>::eof();
+        uint64_t symbols = 0;
+        for (size_t w = 0; w < K; w++)
+        {
+            int c = in->sgetc();
+            while (c != END && isspace(c))
+                c = in->snextc();
+            for (; c != END && !isspace(c) && symbols < uint64_t(INT_MAX / 2);
+                 c = in->snextc())
+            {
+                out.put(c);
+                symbols++;
+            }
+            symbols++;
+            // Node indices are ints and a tree has up to 2n + 1 nodes.
+            if (symbols > uint64_t(INT_MAX / 2))
+            {
+                out.close();
+                remove(textFile.c_str());
+                return "The input is too large.";
+            }
+            out.put(TERMINATOR + int(w));
+            wordEnds.push_back(symbols);
+        }
+        if (!out.close())
+            return "Cannot write the index " + fileName + ".";
+    }
+    int n = K ? int(wordEnds.back()) : 0;
+
+    string error;
+    MappedFile textMap;
+    if (n == 0 || !textMap.open(textFile))
+        error = n == 0 ? "The input is empty." : "Cannot write the index " + fileName + ".";
+    const int* symbols = static_cast<const int*>(textMap.data);
+    if (error.empty() && !externalSuffixArray(symbols, n, memory, fileName))
+        error = "Cannot write the index " + fileName + ".";
+
+    if (error.empty())
+    {
+        int internal = IndexBuilder::internalNodes(fileName, bufferInts);
+        int nodeCount = n + internal;
+        IndexHeader header = indexLayout(K, n, nodeCount);
+        // The header, word ends and text go out in order; the tree's
+        // arrays are zeros to fill in through the mapping.
+        FILE* out = fopen(fileName.c_str(), "wb");
+        bool ok = internal > 0 && out != 0 && fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  fseek(out, header.wordEndsOffset, SEEK_SET) == 0 &&
+                  fwrite(wordEnds.data(), sizeof(uint64_t), K, out) == K &&
+                  fseek(out, header.textOffset, SEEK_SET) == 0 &&
+                  fwrite(symbols, sizeof(int), n, out) == size_t(n);
+        ok = out != 0 && fclose(out) == 0 && ok &&
+             truncate(fileName.c_str(), header.fileSize) == 0;
+
+        MappedFile index;
+        ok = ok && index.open(fileName, true);
+        if (ok)
+        {
+            char* base = static_cast<char*>(index.data);
+            int* childBegin = reinterpret_cast<int*>(base + header.childBeginOffset);
+            IndexBuilder builder(fileName, bufferInts, n,
+                                 reinterpret_cast<Node*>(base + header.nodesOffset),
+                                 childBegin,
+                                 reinterpret_cast<int*>(base + header.childrenOffset),
+                                 reinterpret_cast<int*>(base + header.suffixCountsOffset));
+            ok = builder.scan(false);
+            // Child counts to list starts, used as cursors by the second
+            // scan, which leaves each at the start of the next list.
+            for (int v = 0; ok && v < nodeCount; v++)
+                childBegin[v + 1] += childBegin[v];
+            ok = ok && builder.scan(true);
+            for (int v = nodeCount; ok && v > 0; v--)
+                childBegin[v] = childBegin[v - 1];
+            childBegin[0] = 0;
+            ok = ok && msync(index.data, index.size, MS_SYNC) == 0;
+        }
+        if (!ok)
+            error = "Cannot write the index " + fileName + ".";
+    }
+    remove(textFile.c_str());
+    remove((fileName + ".sa").c_str());
+    remove((fileName + ".lcp").c_str());
+    return error;
+}
+
+// Packs the text if it has at most four different bytes, or numbers
+// its terminators, and drops it, then builds the tree and counts the
+// words below its nodes.
+void buildWordTree()
+{
+    packedText = packed.pack(text, wordEnds);
+    if (!packedText)
+    {
+        s.reserve(text.size());
+        for (size_t i = 0, w = 0; i < text.size(); i++)
+            if (i + 1 == wordEnds[w])
+                s.push_back(TERMINATOR + int(w++));
+            else
+                s.push_back((unsigned char)text[i]);
+    }
+    string().swap(text);
+
+    STree tree;
+    tree.buildTree();
+    tree.closeLeaves();
+    countWords();
+}
+
+void printLabel(const TreeView& tree, int node)
+{
+    int end = tree.nodes[node].start + tree.nodes[node].depth;
+    for (int i = tree.nodes[node].start; i < end; i++)
+        cout << char(tree.symbol(i));
+}
+
+// The tree engine: the deepest node with leaves of all the words, or
+// of at least k words for every k.
+void treeLongestCommon(const TreeView& tree, bool allK)
+{
+    uint64_t words = tree.words;
+    const Node* nodes = tree.nodes;
+
+    // For a single word it is the longest word.
+    uint64_t longestBegin = 0, longestEnd = 0;
+    for (uint64_t i = 0, begin = 0; i < words; begin = tree.wordEnds[i++])
+        if (tree.wordEnds[i] - begin > longestEnd - longestBegin)
+        {
+            longestBegin = begin;
+            longestEnd = tree.wordEnds[i];
+        }
+    if (words == 1 && !allK)
+    {
+        for (uint64_t i = longestBegin; i + 1 < longestEnd; i++)
+            cout << char(tree.symbol(i));
+        return;
+    }
+
+    if (allK)
+    {
+        // Deepest node with exactly k words, then with at least k.
+        vector<int> deepest(words + 1, -1);
+        for (size_t i = 0; i < tree.nodeCount; i++)
+        {
+            int k = nodes[i].words;
+            if (deepest[k] < 0 || nodes[i].depth > nodes[deepest[k]].depth)
+                deepest[k] = int(i);
+        }
+        for (size_t k = words; k-- > 2;)
+            if (deepest[k] < 0 || (deepest[k + 1] >= 0 &&
+                    nodes[deepest[k + 1]].depth > nodes[deepest[k]].depth))
+                deepest[k] = deepest[k + 1];
+
+        cout << 1 << ' ' << longestEnd - longestBegin - 1 << ' ';
+        for (uint64_t i = longestBegin; i + 1 < longestEnd; i++)
+            cout << char(tree.symbol(i));
+        cout << '\n';
+
+        for (size_t k = 2; k <= words; k++)
+        {
+            cout << k << ' ' << nodes[deepest[k]].depth << ' ';
+            printLabel(tree, deepest[k]);
+            cout << '\n';
+        }
+        return;
+    }
+
+    int deepestNode = -1;
+    for (size_t i = 0; i < tree.nodeCount; i++)
+    {
+        if (uint64_t(nodes[i].words) < words)
+            continue;
+
+        if (deepestNode < 0 || nodes[i].depth > nodes[deepestNode].depth)
+            deepestNode = int(i);
+    }
+
+    if (deepestNode >= 0)
+        printLabel(tree, deepestNode);
+}
+
+// Queries over a built tree. The tree is never modified, so any number
+// of threads may query it at once.
+
+// The node at or below the end of the pattern's path, -1 if the
+// pattern does not occur.
+int findLocus(const TreeView& tree, const string& pattern)
+{
+    int node = 0;
+    size_t matched = 0;
+    while (matched < pattern.size())
+    {
+        node = tree.child(node, (unsigned char)pattern[matched]);
+        if (node < 0)
+            return -1;
+        const Node& child = tree.nodes[node];
+        size_t end = min(size_t(child.depth), pattern.size());
+        for (matched++; matched < end; matched++)
+            if (tree.symbol(child.start + matched) != (unsigned char)pattern[matched])
+                return -1;
+    }
+    return node;
+}
+
+// Calls visit with the start of every suffix below the node, except
+// those beginning with a terminator.
+template <class Visit>
+void forEachSuffix(const TreeView& tree, int node, Visit visit)
+{
+    vector<int> stack(1, node);
+    while (!stack.empty())
+    {
+        int v = stack.back();
+        stack.pop_back();
+        int first = tree.childBegin[v], last = tree.childBegin[v + 1];
+        if (first == last && tree.symbol(tree.nodes[v].start) < TERMINATOR)
+            visit(tree.nodes[v].start);
+        for (int i = last; i-- > first;)
+            stack.push_back(tree.children[i]);
+    }
+}
+
+// The deepest internal node, whose label is the longest substring that
+// occurs twice. Labels with a terminator occur once, so they end in a
+// leaf and the label never spans two words.
+int deepestInternal(const TreeView& tree)
+{
+    int deepest = 0;
+    for (size_t i = 0; i < tree.nodeCount; i++)
+        if (tree.childBegin[i] < tree.childBegin[i + 1] &&
+            tree.nodes[i].depth > tree.nodes[deepest].depth)
+            deepest = int(i);
+    return deepest;
+}
+
+// For every position i of the pattern, the length of the longest
+// prefix of pattern[i, end) that occurs in the words. Suffix links take
+// the match from one position to the next, so the whole pattern costs
+// linear time (Chang & Lawler).
+void matchingStatistics(const TreeView& tree, const string& pattern,
+                        vector<int>& lengths)
+{
+    lengths.assign(pattern.size(), 0);
+    // The match ends on the edge into node, or at node if it's as deep.
+    int node = 0, matched = 0;
+    int m = int(pattern.size());
+    for (int i = 0; i < m; i++)
+    {
+        while (i + matched < m)
+        {
+            int c = (unsigned char)pattern[i + matched];
+            if (matched == tree.nodes[node].depth)
+            {
+                int child = tree.child(node, c);
+                if (child < 0)
+                    break;
+                node = child;
+            }
+            if (tree.symbol(tree.nodes[node].start + matched) != c)
+                break;
+            matched++;
+        }
+        lengths[i] = matched;
+        if (matched == 0)
+        {
+            node = 0;
+            continue;
+        }
+
+        // Drop the first symbol: follow the suffix link of the deepest
+        // node on the match, or restart at the root in an index built
+        // without links, then walk down by edge lengths alone.
+        int above = matched == tree.nodes[node].depth ? node
+                                                       : tree.nodes[node].parent;
+        node = above == 0 ? 0 : max(tree.nodes[above].suffixLink, 0);
+        matched--;
+        while (tree.nodes[node].depth < matched)
+            node = tree.child(node, (unsigned char)pattern[i + 1 + tree.nodes[node].depth]);
+    }
+}
+
+uint64_t wordAt(const TreeView& tree, uint64_t position)
+{
+    return upper_bound(tree.wordEnds, tree.wordEnds + tree.words, position) -
+           tree.wordEnds;
+}
+
+// Answers one line of a query file:
+//   exists PATTERN    1 if the pattern occurs in a word, 0 if not
+//   count PATTERN     number of occurrences
+//   locate PATTERN    "word:offset" of every occurrence, in text order
+//   repeated          "length substring", the longest repeated substring
+//   matching PATTERN  the matching statistics of the pattern
+string answerQuery(const TreeView& tree, const string& query,
+                   int repeatedNode)
+{
+    size_t space = query.find(' ');
+    string command = query.substr(0, space);
+    string pattern = space == string::npos ? string() : query.substr(space + 1);
+
+    ostringstream answer;
+    if (command == "exists")
+    {
+        answer << (findLocus(tree, pattern) >= 0 ? 1 : 0);
+    }
+    else if (command == "count")
+    {
+        int locus = findLocus(tree, pattern);
+        answer << (locus >= 0 ? tree.suffixCounts[locus] : 0);
+    }
+    else if (command == "locate")
+    {
+        int locus = findLocus(tree, pattern);
+        vector<int> starts;
+        if (locus >= 0)
+            forEachSuffix(tree, locus, [&starts](int start)
+                          {
+                              starts.push_back(start);
+                          });
+        sort(starts.begin(), starts.end());
+        for (size_t i = 0; i < starts.size(); i++)
+        {
+            uint64_t word = wordAt(tree, starts[i]);
+            uint64_t begin = word == 0 ? 0 : tree.wordEnds[word - 1];
+            answer << (i ? " " : "") << word << ':' << starts[i] - begin;
+        }
+    }
+    else if (command == "repeated" && repeatedNode >= 0)
+    {
+        const Node& node = tree.nodes[repeatedNode];
+        answer << node.depth << ' ';
+        for (int i = node.start; i < node.start + node.depth; i++)
+            answer << char(tree.symbol(i));
+    }
+    else if (command == "matching")
+    {
+        vector<int> lengths;
+        matchingStatistics(tree, pattern, lengths);
+        for (size_t i = 0; i < lengths.size(); i++)
+            answer << (i ? " " : "") << lengths[i];
+    }
+    else
+    {
+        answer << "Unknown query.";
+    }
+    return answer.str();
+}
+
+// Answers the queries of a file, one per line, on several threads, and
+// prints the answers in the order of the queries. False if the file
+// cannot be read.
+bool runQueries(const TreeView& tree, const string& fileName,
+                unsigned threadCount)
+{
+    ifstream in(fileName.c_str());
+    if (!in)
+        return false;
+    vector<string> queries;
+    bool repeated = false;
+    for (string line; getline(in, line);)
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        repeated = repeated || line.compare(0, 8, "repeated") == 0;
+        queries.push_back(line);
+    }
+    // The same for every query, so it's found once.
+    int repeatedNode = repeated ? deepestInternal(tree) : -1;
+
+    // Threads take queries in chunks from a shared counter, so that
+    // slow queries don't hold the others back.
+    const size_t CHUNK = 64;
+    vector<string> answers(queries.size());
+    atomic<size_t> next(0);
+    auto work = [&]()
+    {
+        for (size_t begin; (begin = next.fetch_add(CHUNK)) < queries.size();)
+            for (size_t i = begin; i < min(begin + CHUNK, queries.size()); i++)
+                answers[i] = answerQuery(tree, queries[i], repeatedNode);
+    };
+    vector<thread> threads;
+    for (unsigned i = 1; i < threadCount; i++)
+        threads.push_back(thread(work));
+    work();
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    for (size_t i = 0; i < answers.size(); i++)
+        cout << answers[i] << '\n';
+    return true;
+}
+
+// Every maximal substring common to at least k >= 2 words: a node of
+// k words or more, none of whose children has k (else the substring
+// extends to the right), and whose occurrences don't share a preceding
+// symbol in k words (else it extends to the left). Such nodes are never
+// below each other, so one walk down the nodes of k words or more
+// checks each leaf once. Prints "length substring word:offset..." for
+// each as it is found, in the order of their labels, or with top > 0
+// only the top longest, the longest first, which is all that is kept
+// while walking.
+void maximalCommon(const TreeView& tree, int k, size_t top)
+{
+    vector<int> starts;
+    auto print = [&](int v)
+    {
+        cout << tree.nodes[v].depth << ' ';
+        printLabel(tree, v);
+        starts.clear();
+        forEachSuffix(tree, v, [&starts](int start)
+                      {
+                          starts.push_back(start);
+                      });
+        sort(starts.begin(), starts.end());
+        for (size_t j = 0; j < starts.size(); j++)
+        {
+            uint64_t word = wordAt(tree, starts[j]);
+            uint64_t begin = word == 0 ? 0 : tree.wordEnds[word - 1];
+            cout << ' ' << word << ':' << starts[j] - begin;
+        }
+        cout << '\n';
+    };
+
+    // Found in the order of their labels, as children are sorted.
+    struct Found
+    {
+        int depth, order, node;
+
+        bool operator<(const Found& other) const
+        {
+            return depth != other.depth ? depth > other.depth
+                                        : order < other.order;
+        }
+    };
+    vector<Found> found; // A heap of the top ones.
+    int order = 0;
+
+    vector<int> stack(1, 0);
+    vector<pair<int, uint64_t>> before; // (preceding symbol, word).
+    while (!stack.empty())
+    {
+        int v = stack.back();
+        stack.pop_back();
+        bool frontier = true;
+        for (int i = tree.childBegin[v + 1]; i-- > tree.childBegin[v];)
+            if (tree.nodes[tree.children[i]].words >= k)
+            {
+                stack.push_back(tree.children[i]);
+                frontier = false;
+            }
+        if (!frontier || v == 0 || tree.childBegin[v] == tree.childBegin[v + 1])
+            continue;
+
+        before.clear();
+        forEachSuffix(tree, v, [&](int start)
+                      {
+                          int c = start > 0 ? tree.symbol(start - 1) : TERMINATOR;
+                          if (c < TERMINATOR)
+                              before.push_back(make_pair(c, wordAt(tree, start)));
+                      });
+        sort(before.begin(), before.end());
+        before.erase(unique(before.begin(), before.end()), before.end());
+        bool leftMaximal = true;
+        for (size_t i = 0, j; leftMaximal && i < before.size(); i = j)
+        {
+            for (j = i; j < before.size() && before[j].first == before[i].first;)
+                j++;
+            leftMaximal = j - i < size_t(k);
+        }
+        if (!leftMaximal)
+            continue;
+
+        Found next = { tree.nodes[v].depth, order++, v };
+        if (top == 0)
+            print(v);
+        else if (found.size() < top)
+        {
+            found.push_back(next);
+            push_heap(found.begin(), found.end());
+        }
+        else if (next < found.front())
+        {
+            pop_heap(found.begin(), found.end());
+            found.back() = next;
+            push_heap(found.begin(), found.end());
+        }
+    }
+
+    sort(found.begin(), found.end());
+    for (size_t i = 0; i < found.size(); i++)
+        print(found[i].node);
+}
+
+// Word of the suffix at a text position.
+size_t wordOf(int position)
+{
+    return upper_bound(wordEnds.begin(), wordEnds.end(), size_t(position)) -
+           wordEnds.begin();
+}
+
+// The suffix array engine. The suffixes beginning with a substring are
+// adjacent in the suffix array and the substring's length is the
+// minimum LCP between them, so the longest common substring is the
+// largest minimum LCP over the windows of entries which cover all the
+// words. Each window is shrunk from the left as long as it still covers
+// them, the minimum is kept in a monotonic queue. With more than one
+// thread the suffix array is sorted by parallel prefix doubling, which
+// takes more time and memory in all but beats SA-IS on enough cores.
+void arrayLongestCommon(unsigned threadCount)
+{
+    // A window of one entry has no LCP inside; one word is its own answer.
+    if (K == 1)
+    {
+        cout << text.substr(0, text.size() - 1);
+        return;
+    }
+    vector<int> sa = threadCount > 1
+                         ? suffix_array::buildParallel(text, threadCount)
+                         : suffix_array::build(text);
+    vector<int> plcp = suffix_array::permutedLcp(text, sa, SEPARATOR,
+                                                 threadCount);
+
+    vector<int> inWindow(K, 0);
+    size_t covered = 0;
+    deque<int> minima; // Entries of the window with increasing LCP.
+    int best = 0, bestStart = 0;
+    for (int low = 0, high = 0; high < int(sa.size()); high++)
+    {
+        int lcp = plcp[sa[high]];
+        while (!minima.empty() && plcp[sa[minima.back()]] >= lcp)
+            minima.pop_back();
+        minima.push_back(high);
+
+        if (inWindow[wordOf(sa[high])]++ == 0)
+            covered++;
+        while (covered == K)
+        {
+            // The LCP of the lowest entry is with one outside.
+            while (minima.front() <= low)
+                minima.pop_front();
+            int length = plcp[sa[minima.front()]];
+            if (length > best)
+            {
+                best = length;
+                bestStart = sa[high];
+            }
+            if (--inWindow[wordOf(sa[low++])] == 0)
+                covered--;
+        }
+    }
+
+    cout << text.substr(bestStart, best);
+}
+
+// The window mode: the LZ77 factors of a stream of bytes, each the
+// longest prefix of the rest of the stream that occurs in the last
+// windowSize bytes, or a single byte if none does. The match is found by
+// walking down the tree of the window, and the bytes of each factor are
+// then appended to it. Prints "length distance" for a match and
+// "0 byte" for a byte.
+void windowFactors(int windowSize)
+{
+    STree tree;
+    tree.reset(windowSize);
+
+    // At least a window of the stream is kept ahead, as much as a match
+    // can take.
+    string buffer;
+    vector<char> chunk(1 << 16);
+    size_t p = 0;
+    bool end = false;
+    while (true)
+    {
+        if (!end && buffer.size() - p < size_t(windowSize))
+        {
+            buffer.erase(0, p);
+            p = 0;
+            while (!end && buffer.size() < 2 * size_t(windowSize))
+            {
+                cin.read(chunk.data(), chunk.size());
+                buffer.append(chunk.data(), size_t(cin.gcount()));
+                end = !cin;
+            }
+        }
+        if (p == buffer.size())
+            break;
+
+        int node = 0, matched = 0, at = 0;
+        int rest = int(min(buffer.size() - p, size_t(windowSize)));
+        while (matched < rest)
+        {
+            Edge* edge = edges.find(node, (unsigned char)buffer[p + matched]);
+            if (edge == 0)
+                break;
+            at = edge->left - nodes[node].depth;
+            int length = edge->end() - edge->left + 1, k = 1;
+            while (k < length && matched + k < rest &&
+                   symbol(edge->left + k) == (unsigned char)buffer[p + matched + k])
+                k++;
+            matched += k;
+            if (k < length)
+                break;
+            node = edge->childNode;
+        }
+
+        if (matched == 0)
+        {
+            cout << "0 " << int((unsigned char)buffer[p]) << '\n';
+            matched = 1;
+        }
+        else
+        {
+            cout << matched << ' ' << front - at << '\n';
+        }
+        for (int k = 0; k < matched; k++)
+            tree.append((unsigned char)buffer[p + k]);
+        p += matched;
+    }
+}
+
+// The longest common substring, or the answers to a query file.
+void answer(const TreeView& tree, bool allK, const string& queryFile,
+            unsigned threadCount, int maximalK, size_t top)
+{
+    if (maximalK > 0)
+        maximalCommon(tree, maximalK, top);
+    else if (queryFile.empty())
+        treeLongestCommon(tree, allK);
+    else if (!runQueries(tree, queryFile, threadCount))
+        cout << "Cannot read the queries " << queryFile << '.';
+}
+
+// Reads the K words, each followed by the separator.
+void readWords()
+{
+    for (size_t i = 0; i < K; i++)
+    {
+        string str;
+        cin >> str;
+
+        text += str;
+        text += SEPARATOR;
+        wordEnds.push_back(text.size());
+    }
+}
+
+// The benchmark: every engine on the same generated inputs, each run in
+// a child process of its own, as the engines build in the globals and
+// so that its peak RSS is its own. A child reads the input from a file,
+// as from stdin, and answers like the command would.
+const char* BENCH_INPUTS[] = { "random", "repetitive", "dna", "natural" };
+
+struct BenchEngine
+{
+    const char* name;
+    bool allThreads; // On --threads threads instead of one.
+};
+
+const BenchEngine BENCH_ENGINES[] = { { "tree", false }, { "sa", false },
+                                      { "sa", true }, { "external", false } };
+const int BENCH_QUERIES = 10000;
+
+// Writes size symbols of an input kind, split into k words.
+bool generateInput(const string& kind, size_t size, size_t k,
+                   const string& fileName)
+{
+    mt19937_64 random(20131224);
+    // Repetitive: copies of a random period, with a few mutations.
+    string period(997, 0);
+    for (size_t i = 0; i < period.size(); i++)
+        period[i] = char('a' + random() % 26);
+    // Natural: a Zipf distributed vocabulary joined by underscores.
+    vector<string> vocabulary(10000);
+    for (size_t i = 0; i < vocabulary.size(); i++)
+        for (size_t length = 1 + random() % 10; length > 0; length--)
+            vocabulary[i] += char('a' + random() % 26);
+    vector<double> weights(vocabulary.size());
+    for (size_t i = 0; i < weights.size(); i++)
+        weights[i] = 1.0 / (i + 1);
+    discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+
+    ofstream out(fileName.c_str());
+    out << k << '\n';
+    string word, pending;
+    for (size_t w = 0, position = 0; w < k; w++)
+    {
+        size_t length = size / k + (w < size % k);
+        word.clear();
+        while (word.size() < length)
+        {
+            if (kind == "random")
+                word += char('a' + random() % 26);
+            else if (kind == "dna")
+                word += "acgt"[random() % 4];
+            else if (kind == "repetitive")
+                word += random() % 1000 ? period[position++ % period.size()]
+                                        : char('a' + random() % 26);
+            else
+            {
+                if (pending.empty())
+                    pending = vocabulary[zipf(random)] + '_';
+                size_t take = min(pending.size(), length - word.size());
+                word += pending.substr(0, take);
+                pending.erase(0, take);
+            }
+        }
+        out << word << '\n';
+    }
+    out.close();
+    return !out.fail();
+}
+
+struct BenchResult
+{
+    double seconds, queryMicros; // queryMicros < 0 if not measured.
+};
+
+// The mean time of count queries for substrings of the text.
+double queryLatency(const TreeView& tree)
+{
+    mt19937_64 random(20131224);
+    vector<string> queries;
+    while (queries.size() < size_t(BENCH_QUERIES) && tree.symbols > 16)
+    {
+        uint64_t start = random() % (tree.symbols - 16);
+        string query = "count ";
+        for (uint64_t i = start; i < start + 4 + random() % 12; i++)
+            if (tree.symbol(i) < TERMINATOR)
+                query += char(tree.symbol(i));
+        queries.push_back(query);
+    }
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < queries.size(); i++)
+        answerQuery(tree, queries[i], -1);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return queries.empty() ? 0 : seconds * 1e6 / queries.size();
+}
+
+// Runs an engine as the command would, in the child process.
+BenchResult benchEngine(const string& engine, unsigned threadCount,
+                        size_t memory, const string& inputFile)
+{
+    BenchResult result = { 0, -1 };
+    auto start = chrono::steady_clock::now();
+    auto elapsed = [&start]()
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    cin >> K;
+    if (engine == "external")
+    {
+        string indexFile = inputFile + ".ix";
+        buildIndexExternally(indexFile, memory);
+        MappedIndex index;
+        TreeView tree;
+        if (index.open(indexFile, tree))
+        {
+            treeLongestCommon(tree, false);
+            result.seconds = elapsed();
+            result.queryMicros = queryLatency(tree);
+        }
+        remove(indexFile.c_str());
+        return result;
+    }
+    readWords();
+    if (engine == "sa")
+    {
+        arrayLongestCommon(threadCount);
+        result.seconds = elapsed();
+        return result;
+    }
+    buildWordTree();
+    TreeView tree = flattenTree();
+    treeLongestCommon(tree, false);
+    result.seconds = elapsed();
+    result.queryMicros = queryLatency(tree);
+    return result;
+}
+
+// Prints a CSV line per input and engine: the time to read the input
+// and answer, per character, the peak RSS, in all and per character,
+// and the latency of count queries.
+void bench(const vector<size_t>& sizes, const vector<size_t>& ks,
+           unsigned threadCount, size_t memory)
+{
+    char name[] = "/tmp/suffix_tree_bench.XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0)
+    {
+        cout << "Cannot write the input " << name << '.';
+        return;
+    }
+    close(fd);
+    string inputFile = name;
+
+    cout << "input,size,k,engine,threads,seconds,ns_per_char,peak_rss_mb,"
+         << "bytes_per_char,query_us\n" << flush;
+    for (size_t i = 0; i < sizeof(BENCH_INPUTS) / sizeof(*BENCH_INPUTS); i++)
+        for (size_t s = 0; s < sizes.size(); s++)
+            for (size_t k = 0; k < ks.size() && ks[k] <= sizes[s]; k++)
+            {
+                if (!generateInput(BENCH_INPUTS[i], sizes[s], ks[k], inputFile))
+                {
+                    cout << "Cannot write the input " << inputFile << '.';
+                    remove(inputFile.c_str());
+                    return;
+                }
+                for (size_t e = 0; e < sizeof(BENCH_ENGINES) / sizeof(*BENCH_ENGINES); e++)
+                {
+                    string engine = BENCH_ENGINES[e].name;
+                    unsigned threads = BENCH_ENGINES[e].allThreads ? threadCount : 1;
+                    if (BENCH_ENGINES[e].allThreads && threadCount == 1)
+                        continue;
+
+                    int results[2];
+                    pid_t child = -1;
+                    if (pipe(results) == 0 && (child = fork()) < 0)
+                    {
+                        close(results[0]);
+                        close(results[1]);
+                    }
+                    if (child < 0)
+                    {
+                        cout << "Cannot start the " << engine << " engine.";
+                        remove(inputFile.c_str());
+                        return;
+                    }
+                    if (child == 0)
+                    {
+                        close(results[0]);
+                        int input = ::open(inputFile.c_str(), O_RDONLY);
+                        int null = ::open("/dev/null", O_WRONLY);
+                        dup2(input, 0);
+                        dup2(null, 1);
+                        BenchResult result = benchEngine(engine, threads, memory,
+                                                         inputFile);
+                        ssize_t written = write(results[1], &result, sizeof(result));
+                        _exit(written == ssize_t(sizeof(result)) ? 0 : 1);
+                    }
+                    close(results[1]);
+                    BenchResult result;
+                    bool ok = read(results[0], &result, sizeof(result)) ==
+                                  ssize_t(sizeof(result)) &&
+                              result.seconds > 0;
+                    close(results[0]);
+                    int status = 0;
+                    struct rusage usage;
+                    ok = wait4(child, &status, 0, &usage) == child && ok &&
+                         WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+                    double peakMb = usage.ru_maxrss / 1024.0;
+                    cout << BENCH_INPUTS[i] << ',' << sizes[s] << ',' << ks[k] << ','
+                         << engine << ',' << threads << ',';
+                    if (!ok)
+                        cout << "failed,,,,\n";
+                    else
+                    {
+                        cout << result.seconds << ','
+                             << result.seconds * 1e9 / sizes[s] << ','
+                             << peakMb << ','
+                             << peakMb * (1 << 20) / sizes[s] << ',';
+                        if (result.queryMicros >= 0)
+                            cout << result.queryMicros;
+                        cout << '\n';
+                    }
+                    cout << flush;
+                }
+            }
+    remove(inputFile.c_str());
+}
+
+// Parses a comma separated list of sizes, each with an optional K, M or
+// G suffix. False if one isn't a positive size.
+bool parseSizes(const string& list, vector<size_t>& sizes)
+{
+    sizes.clear();
+    istringstream in(list);
+    for (string item; getline(in, item, ',');)
+    {
+        char* end;
+        size_t size = strtoull(item.c_str(), &end, 10);
+        string suffix = end;
+        if (suffix == "K")
+            size <<= 10;
+        else if (suffix == "M")
+            size <<= 20;
+        else if (suffix == "G")
+            size <<= 30;
+        else if (!suffix.empty())
+            return false;
+        if (size == 0 || size > size_t(INT_MAX / 2))
+            return false;
+        sizes.push_back(size);
+    }
+    return !sizes.empty();
+}
+
+int main(int argc, char* argv[])
+{
+    bool allK = false, usage = false;
+    string engine = "tree", indexFile, buildIndexFile, queryFile;
+    unsigned threadCount = max(1u, thread::hardware_concurrency());
+    int windowSize = 0;
+    size_t memory = 0;
+    bool benchMode = false;
+    int maximalK = 0;
+    size_t top = 0;
+    vector<size_t> benchSizes(1, size_t(1) << 20), benchKs(1, 4);
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--all-k")
+            allK = true;
+        else if (arg.compare(0, 9, "--engine=") == 0)
+            engine = arg.substr(9);
+        else if (arg.compare(0, 8, "--index=") == 0)
+            indexFile = arg.substr(8);
+        else if (arg.compare(0, 14, "--build-index=") == 0)
+            buildIndexFile = arg.substr(14);
+        else if (arg.compare(0, 10, "--queries=") == 0)
+            queryFile = arg.substr(10);
+        else if (arg.compare(0, 10, "--threads=") == 0)
+        {
+            threadCount = unsigned(atoi(arg.c_str() + 10));
+            usage = usage || threadCount == 0;
+        }
+        else if (arg.compare(0, 9, "--memory=") == 0)
+        {
+            memory = size_t(atoi(arg.c_str() + 9)) << 20;
+            usage = usage || memory == 0;
+        }
+        else if (arg.compare(0, 10, "--maximal=") == 0)
+        {
+            maximalK = atoi(arg.c_str() + 10);
+            usage = usage || maximalK < 2;
+        }
+        else if (arg.compare(0, 6, "--top=") == 0)
+        {
+            top = size_t(atoll(arg.c_str() + 6));
+            usage = usage || top == 0;
+        }
+        else if (arg == "--bench")
+            benchMode = true;
+        else if (arg.compare(0, 13, "--bench-size=") == 0)
+            usage = usage || !parseSizes(arg.substr(13), benchSizes);
+        else if (arg.compare(0, 10, "--bench-k=") == 0)
+            usage = usage || !parseSizes(arg.substr(10), benchKs);
+        else if (arg.compare(0, 9, "--window=") == 0)
+        {
+            windowSize = atoi(arg.c_str() + 9);
+            usage = usage || windowSize <= 0 || windowSize > MAX_WINDOW;
+        }
+        else
+            usage = true;
+    }
+    bool treeOnly = allK || !indexFile.empty() || !buildIndexFile.empty() ||
+                    !queryFile.empty() || maximalK > 0;
+    if (usage || (engine != "tree" && engine != "sa") ||
+        (treeOnly && engine != "tree") ||
+        (!indexFile.empty() && !buildIndexFile.empty()) ||
+        (!queryFile.empty() && (allK || !buildIndexFile.empty())) ||
+        (maximalK > 0 && (allK || !queryFile.empty() || !buildIndexFile.empty())) ||
+        (top > 0 && maximalK == 0) ||
+        (windowSize > 0 && (argc > 2)) ||
+        (memory > 0 && buildIndexFile.empty() && !benchMode) ||
+        (benchMode && (treeOnly || engine != "tree" || windowSize > 0)))
+    {
+        cout << "Usage: " << argv[0] << " [--all-k] [--engine=tree|sa]"
+             << " [--index=FILE | --build-index=FILE]\n"
+             << "       [--queries=FILE] [--threads=N] [--memory=MB]"
+             << " [--maximal=K [--top=N]] < input\n"
+             << "       " << argv[0] << " --window=W < stream\n"
+             << "       " << argv[0] << " --bench [--bench-size=SIZES]"
+             << " [--bench-k=KS]\n"
+             << "       [--threads=N] [--memory=MB]\n"
+             << "Reads the number of words K and the words, prints their\n"
+             << "longest common substring, or with --all-k one line\n"
+             << "\"k length substring\" for every k, the longest substring\n"
+             << "common to at least k of the words.\n"
+             << "The tree engine is a suffix tree, the sa engine a suffix\n"
+             << "array with LCP values taking about 9 bytes per character\n"
+             << "instead of the tree's 50 and more; --all-k needs the tree.\n"
+             << "The tree packs words of at most four different bytes, as\n"
+             << "DNA, at 2 bits a symbol.\n"
+             << "--build-index saves the tree of the input to FILE, and\n"
+             << "--index answers from the tree saved in FILE instead of\n"
+             << "reading input. With --memory it builds the index in\n"
+             << "about MB megabytes, sorting on disk next to FILE, with\n"
+             << "4 more bytes of disk per character for each doubling of\n"
+             << "the longest repeat.\n"
+             << "--queries answers the queries in FILE, one per line, on N\n"
+             << "threads: \"exists P\", \"count P\", \"locate P\" (word:offset\n"
+             << "of each occurrence), \"repeated\" (the longest repeated\n"
+             << "substring) and \"matching P\" (matching statistics of P).\n"
+             << "--maximal prints every maximal substring common to at\n"
+             << "least K >= 2 words as it finds it, in label order, with\n"
+             << "--top the N longest only, the longest first: \"length\n"
+             << "substring word:offset...\".\n"
+             << "The sa engine sorts on N threads too, then taking about 13\n"
+             << "bytes per character. N defaults to the number of cores.\n"
+             << "--window prints the LZ77 factors of the stream from a\n"
+             << "suffix tree of its last W bytes: \"length distance\" for\n"
+             << "a repeat, \"0 byte\" for a byte.\n"
+             << "--bench runs every engine on random, repetitive, DNA and\n"
+             << "natural language inputs of each of the comma separated\n"
+             << "SIZES (K, M or G suffixed, 1M by default) split into each\n"
+             << "of KS words (4 by default), and prints a CSV line of the\n"
+             << "time, peak RSS and count query latency of each. The\n"
+             << "external engine is --build-index with --memory, 64 MB by\n"
+             << "default.";
+        return 0;
+    }
+
+    if (windowSize > 0)
+    {
+        windowFactors(windowSize);
+        return 0;
+    }
+    if (benchMode)
+    {
+        bench(benchSizes, benchKs, threadCount, memory ? memory : size_t(64) << 20);
+        return 0;
+    }
+
+    if (!indexFile.empty())
+    {
+        MappedIndex index;
+        TreeView tree;
+        if (!index.open(indexFile, tree))
+        {
+            cout << "Cannot read the index " << indexFile << '.';
+            return 0;
+        }
+        answer(tree, allK, queryFile, threadCount, maximalK, top);
+        return 0;
+    }
+
+    cin >> K;
+
+    if (memory > 0)
+    {
+        string error = buildIndexExternally(buildIndexFile, memory);
+        cout << error;
+        return 0;
+    }
+    if (K == 1 && !allK && buildIndexFile.empty() && queryFile.empty() &&
+        maximalK == 0)
+    {
+        string str;
+        cin >> str;
+        cout << str;
+        return 0;
+    }
+    readWords();
+    // Node indices are ints and a tree has up to 2n + 1 nodes; the
+    // suffix array has an int per symbol and the sentinel.
+    size_t limit = engine == "sa" ? size_t(INT_MAX - 1) : size_t(INT_MAX / 2);
+    if (text.size() > limit)
+    {
+        cout << "The input is too large.";
+        return 0;
+    }
+
+    if (engine == "sa")
+    {
+        arrayLongestCommon(threadCount);
+        return 0;
+    }
+
+    buildWordTree();
+    TreeView tree = flattenTree();
+    if (!buildIndexFile.empty())
+    {
+        if (!writeIndex(buildIndexFile, tree))
+            cout << "Cannot write the index " << buildIndexFile << '.';
+        return 0;
     }
+    answer(tree, allK, queryFile, threadCount, maximalK, top);
 }
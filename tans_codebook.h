@@ -0,0 +1,378 @@
+// Table-based asymmetric numeral system (tANS) coding of bytes, the
+// alternative backend to huffman_codebook.h. It takes the same ALPHABET
+// histograms, but a symbol may cost a fraction of a bit, so skewed data
+// codes close to its entropy.
+
+#ifndef TANS_CODEBOOK_H
+#define TANS_CODEBOOK_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "huffman_codebook.h"
+
+namespace tans
+{
+
+using huffman::ALPHABET;
+
+// The coder has TABLE_SIZE states; symbol probabilities are multiples
+// of 1 / TABLE_SIZE. At most TABLE_LOG bits are written per symbol.
+const unsigned TABLE_LOG = 11;
+const uint32_t TABLE_SIZE = uint32_t( 1 ) << TABLE_LOG;
+
+inline unsigned highest_bit( uint32_t v )
+{
+    return 31 - __builtin_clz( v );
+}
+
+// Scales a histogram to counts summing to TABLE_SIZE, every used symbol
+// keeping at least 1. The rounding error is spread one count at a time
+// to whichever symbol it costs the fewest bits. Returns false for an
+// empty histogram.
+inline bool normalize( const uint64_t* freq, uint16_t* norm )
+{
+    double total = 0;
+    for ( size_t s = 0; s < ALPHABET; s++ )
+        total += double( freq[s] );
+    if ( total == 0 )
+        return false;
+
+    int64_t sum = 0;
+    for ( size_t s = 0; s < ALPHABET; s++ ) {
+        norm[s] = 0;
+        if ( freq[s] > 0 )
+            norm[s] = uint16_t( std::max( 1.0, std::floor(
+                double( freq[s] ) * TABLE_SIZE / total ) ) );
+        sum += norm[s];
+    }
+    // Bits saved by one more count, or lost by one less.
+    double gain[ ALPHABET ], loss[ ALPHABET ];
+    auto update = [&]( size_t s ) {
+        double f = double( freq[s] );
+        gain[s] = f > 0 ? f * std::log2( ( norm[s] + 1.0 ) / norm[s] ) : -1;
+        loss[s] = norm[s] > 1 ? f * std::log2( norm[s] / ( norm[s] - 1.0 ) )
+                              : HUGE_VAL;
+    };
+    for ( size_t s = 0; s < ALPHABET; s++ )
+        update( s );
+    for ( ; sum != TABLE_SIZE; ) {
+        size_t best = 0;
+        if ( sum < int64_t( TABLE_SIZE ) ) {
+            for ( size_t s = 1; s < ALPHABET; s++ )
+                if ( gain[s] > gain[best] )
+                    best = s;
+            norm[best]++;
+            sum++;
+        } else {
+            for ( size_t s = 1; s < ALPHABET; s++ )
+                if ( loss[s] < loss[best] )
+                    best = s;
+            norm[best]--;
+            sum--;
+        }
+        update( best );
+    }
+    return true;
+}
+
+// Encoder step of a symbol: the number of bits to flush from a state x
+// is ( x + delta_bits ) >> 16, and the next state is found at
+// ( x >> bits ) + delta_state in the state table.
+struct SymbolTransform
+{
+    int32_t delta_state;
+    uint32_t delta_bits;
+};
+
+// Decoder step of a state: its symbol, then the next state is
+// next_state plus the following bits of the stream.
+struct DecodeEntry
+{
+    uint16_t next_state;
+    uint8_t symbol;
+    uint8_t bits;
+};
+
+// LSB first bit buffer, flushed to memory whole bytes at a time.
+struct BitWriter
+{
+    void init( uint8_t* out )
+    {
+        p = out;
+        acc = 0;
+        count = 0;
+    }
+
+    void put( uint32_t value, unsigned bits )
+    {
+        acc |= uint64_t( value & ( ( uint32_t( 1 ) << bits ) - 1 ) ) << count;
+        count += bits;
+    }
+
+    // Writes 8 bytes, so the output needs that much slack. Like
+    // get_be64() the word copies assume a little endian host.
+    void flush()
+    {
+        std::memcpy( p, &acc, 8 );
+        p += count >> 3;
+        acc >>= count & ~7u;
+        count &= 7;
+    }
+
+    uint8_t* p;
+    uint64_t acc;
+    unsigned count;
+};
+
+// Reads a BitWriter stream backwards, the last bits written first.
+struct BackwardBitReader
+{
+    // The stream ends with a 1 bit written after all data.
+    bool init( const uint8_t* src, size_t size )
+    {
+        if ( size == 0 || src[ size - 1 ] == 0 )
+            return false;
+        start = src;
+        slack = 0;
+        if ( size < 8 ) {
+            // Streams shorter than a word are read from a zero-filled
+            // copy; the leading zeros are never consumed.
+            std::memset( tail, 0, sizeof( tail ) );
+            std::memcpy( tail + 8 - size, src, size );
+            start = tail;
+            slack = ( 8 - size ) * 8;
+            size = 8;
+        }
+        p = start + size - 8;
+        std::memcpy( &buf, p, 8 );
+        consumed = 8 - highest_bit( start[ size - 1 ] );
+        return true;
+    }
+
+    // Moves the word down by the bytes consumed. A valid stream never
+    // consumes more bits than it has.
+    bool reload()
+    {
+        size_t back = consumed >> 3;
+        if ( size_t( p - start ) >= back ) {
+            p -= back;
+            consumed &= 7;
+        } else {
+            consumed -= unsigned( p - start ) * 8;
+            p = start;
+            if ( consumed > 64 )
+                return false;
+        }
+        std::memcpy( &buf, p, 8 );
+        return true;
+    }
+
+    uint32_t read( unsigned bits )
+    {
+        uint64_t v = ( ( buf << ( consumed & 63 ) ) >> 1 ) >> ( 63 - bits );
+        consumed += bits;
+        return uint32_t( v );
+    }
+
+    // True once exactly the whole stream has been read.
+    bool finished() const
+    {
+        return size_t( p - start ) * 8 + 64 - consumed == slack;
+    }
+
+    const uint8_t* start;
+    const uint8_t* p;
+    uint64_t buf;
+    unsigned consumed;
+    size_t slack;
+    uint8_t tail[8];
+};
+
+// Upper bound of TansCodebook::encode's output.
+inline size_t payload_bound( size_t n )
+{
+    return n * TABLE_LOG / 8 + 16;
+}
+
+// Normalized counts of a byte alphabet and the encoder and decoder
+// tables spread from them. Like HuffmanCodebook it has no heap members
+// and is serialized as its counts alone.
+class TansCodebook
+{
+public:
+    // Builds the tables of a histogram of ALPHABET counts. Returns false
+    // for an empty histogram.
+    bool build( const uint64_t* freq )
+    {
+        uint16_t norm[ ALPHABET ];
+        return normalize( freq, norm ) && assign( norm );
+    }
+
+    // Spreads the symbols over the states and fills both tables. Returns
+    // false unless the counts sum to TABLE_SIZE.
+    bool assign( const uint16_t* norm )
+    {
+        uint32_t sum = 0;
+        for ( size_t s = 0; s < ALPHABET; s++ )
+            sum += norm[s];
+        if ( sum != TABLE_SIZE )
+            return false;
+        std::memcpy( norm_, norm, sizeof( norm_ ) );
+
+        // Each symbol's states are scattered over the table by an odd
+        // step, which visits every state once.
+        uint8_t spread[ TABLE_SIZE ];
+        const uint32_t step = ( TABLE_SIZE >> 1 ) + ( TABLE_SIZE >> 3 ) + 3;
+        uint32_t pos = 0;
+        for ( size_t s = 0; s < ALPHABET; s++ )
+            for ( uint32_t i = 0; i < norm[s]; i++ ) {
+                spread[ pos ] = uint8_t( s );
+                pos = ( pos + step ) & ( TABLE_SIZE - 1 );
+            }
+
+        uint32_t first[ ALPHABET ], next[ ALPHABET ];
+        for ( uint32_t s = 0, total = 0; s < ALPHABET; s++ ) {
+            first[s] = next[s] = total;
+            total += norm[s];
+        }
+        for ( uint32_t u = 0; u < TABLE_SIZE; u++ ) {
+            uint8_t s = spread[u];
+            uint32_t x = norm[s] + next[s]++ - first[s];
+            unsigned bits = TABLE_LOG - highest_bit( x );
+            state_[ first[s] + x - norm[s] ] = uint16_t( TABLE_SIZE + u );
+            decode_[u].symbol = s;
+            decode_[u].bits = uint8_t( bits );
+            decode_[u].next_state = uint16_t( ( x << bits ) - TABLE_SIZE );
+        }
+
+        for ( size_t s = 0; s < ALPHABET; s++ ) {
+            if ( norm[s] == 0 ) {
+                symbol_[s].delta_state = 0;
+                symbol_[s].delta_bits = 0;
+                continue;
+            }
+            // States x >= norm << bits flush one bit more than the rest.
+            unsigned bits = norm[s] == 1
+                ? TABLE_LOG : TABLE_LOG - highest_bit( norm[s] - 1u );
+            symbol_[s].delta_bits = ( bits << 16 ) - ( uint32_t( norm[s] )
+                                                       << bits );
+            symbol_[s].delta_state = int32_t( first[s] ) - norm[s];
+        }
+        return true;
+    }
+
+    // The serialized codebook is its ALPHABET 16-bit counts.
+    static const size_t SERIALIZED_SIZE = 2 * ALPHABET;
+
+    void serialize( uint8_t* out ) const
+    {
+        for ( size_t s = 0; s < ALPHABET; s++ ) {
+            out[ 2 * s ] = uint8_t( norm_[s] );
+            out[ 2 * s + 1 ] = uint8_t( norm_[s] >> 8 );
+        }
+    }
+
+    bool deserialize( const uint8_t* in )
+    {
+        uint16_t norm[ ALPHABET ];
+        for ( size_t s = 0; s < ALPHABET; s++ )
+            norm[s] = uint16_t( in[ 2 * s ] | ( in[ 2 * s + 1 ] << 8 ) );
+        return assign( norm );
+    }
+
+    // Average cost of a symbol in bits, -log2 of its probability.
+    double cost( uint8_t symbol ) const
+    {
+        return norm_[ symbol ] == 0
+            ? HUGE_VAL : TABLE_LOG - std::log2( double( norm_[ symbol ] ) );
+    }
+
+    // Codes n symbols, all of which must have a nonzero count, into out,
+    // which must hold payload_bound( n ) bytes. Two states take turns,
+    // so the decoder has two independent chains of table lookups. The
+    // symbols are coded last to first, which the decoder reverses.
+    size_t encode( const uint8_t* data, size_t n, uint8_t* out ) const
+    {
+        uint32_t state[2] = { TABLE_SIZE, TABLE_SIZE };
+        BitWriter bits;
+        bits.init( out );
+        for ( size_t i = n; i-- > 0; ) {
+            uint32_t& x = state[ i & 1 ];
+            const SymbolTransform& t = symbol_[ data[i] ];
+            unsigned count = ( x + t.delta_bits ) >> 16;
+            bits.put( x, count );
+            x = state_[ ( x >> count ) + t.delta_state ];
+            bits.flush();
+        }
+        bits.put( state[0] - TABLE_SIZE, TABLE_LOG );
+        bits.put( state[1] - TABLE_SIZE, TABLE_LOG );
+        bits.put( 1, 1 );
+        bits.flush();
+        return bits.p - out + ( bits.count > 0 );
+    }
+
+    // Decodes n symbols, reading the payload from its end. Returns false
+    // on a corrupted payload.
+    bool decode( const uint8_t* src, size_t src_size,
+                 uint8_t* dst, size_t n ) const
+    {
+        BackwardBitReader in;
+        if ( !in.init( src, src_size ) )
+            return false;
+        uint32_t state[2];
+        state[1] = in.read( TABLE_LOG );
+        state[0] = in.read( TABLE_LOG );
+
+        // Four symbols take at most 4 * TABLE_LOG bits of a reload.
+        size_t i = 0;
+        for ( ; i + 4 <= n; i += 4 ) {
+            if ( !in.reload() )
+                return false;
+            for ( size_t j = 0; j < 4; j++ ) {
+                const DecodeEntry& e = decode_[ state[ j & 1 ] ];
+                dst[ i + j ] = e.symbol;
+                state[ j & 1 ] = e.next_state + in.read( e.bits );
+            }
+        }
+        for ( ; i < n; i++ ) {
+            if ( !in.reload() )
+                return false;
+            const DecodeEntry& e = decode_[ state[ i & 1 ] ];
+            dst[i] = e.symbol;
+            state[ i & 1 ] = e.next_state + in.read( e.bits );
+        }
+        // The encoder started from state 0 of both chains.
+        return in.reload() && in.finished()
+            && state[0] == 0 && state[1] == 0;
+    }
+
+    uint16_t count( uint8_t symbol ) const { return norm_[ symbol ]; }
+
+    // Most symbols a payload of size bytes can decode to. A state that
+    // reads no bits moves to a lower state, so each chain reads a bit at
+    // least every TABLE_SIZE symbols. SIZE_MAX if one symbol owns every
+    // state, as its symbols then cost nothing.
+    size_t max_symbols( size_t size ) const
+    {
+        for ( size_t s = 0; s < ALPHABET; s++ )
+            if ( norm_[s] == TABLE_SIZE )
+                return SIZE_MAX;
+        if ( size > SIZE_MAX / ( 16 * TABLE_SIZE ) - 1 )
+            return SIZE_MAX;
+        return 2 * TABLE_SIZE * ( 8 * size + 1 );
+    }
+
+private:
+    uint16_t norm_[ ALPHABET ];
+    uint16_t state_[ TABLE_SIZE ];
+    SymbolTransform symbol_[ ALPHABET ];
+    DecodeEntry decode_[ TABLE_SIZE ];
+};
+
+} // namespace tans
+
+#endif // TANS_CODEBOOK_H